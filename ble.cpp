@@ -1,5 +1,11 @@
 #include "ble.hpp"
+#include "boot.hpp"
 #include "config.hpp"
+#include "gps.hpp"
+#include "telemetry.hpp"
+#include "time_sync.hpp"
+#include "time_zone.hpp"
+#include "timing.hpp"
 #include "btstack.h"
 #include "btstack_run_loop_embedded.h"
 #include "hci_dump_embedded_stdout.h"
@@ -9,13 +15,26 @@
 #include "ble_config.h"
 #include "hardware/flash.h"
 #include <format>
+#include <optional>
 
 #define CH_COMMAND       ATT_CHARACTERISTIC_00000002_B0A0_475D_A2F4_A32CD026A911_01_VALUE_HANDLE
 #define CH_TIME          ATT_CHARACTERISTIC_00000003_B0A0_475D_A2F4_A32CD026A911_01_VALUE_HANDLE
-#define CH_TIME_CFG      ATT_CHARACTERISTIC_00000003_B0A0_475D_A2F4_A32CD026A911_01_CLIENT_CONFIGURATION_HANDLE
 #define CH_TIME_ZONE     ATT_CHARACTERISTIC_00000004_B0A0_475D_A2F4_A32CD026A911_01_VALUE_HANDLE
 #define CH_BRIGHT        ATT_CHARACTERISTIC_00000005_B0A0_475D_A2F4_A32CD026A911_01_VALUE_HANDLE
 #define CH_TIME_ACC      ATT_CHARACTERISTIC_00000006_B0A0_475D_A2F4_A32CD026A911_01_VALUE_HANDLE
+#define CH_TIMING        ATT_CHARACTERISTIC_00000007_B0A0_475D_A2F4_A32CD026A911_01_VALUE_HANDLE
+#define CH_BOOT          ATT_CHARACTERISTIC_00000008_B0A0_475D_A2F4_A32CD026A911_01_VALUE_HANDLE
+#define CH_STATUS        ATT_CHARACTERISTIC_00000009_B0A0_475D_A2F4_A32CD026A911_01_VALUE_HANDLE
+#define CH_STATUS_CFG    ATT_CHARACTERISTIC_00000009_B0A0_475D_A2F4_A32CD026A911_01_CLIENT_CONFIGURATION_HANDLE
+#define CH_SYNC          ATT_CHARACTERISTIC_0000000A_B0A0_475D_A2F4_A32CD026A911_01_VALUE_HANDLE
+#define CH_SYNC_CFG      ATT_CHARACTERISTIC_0000000A_B0A0_475D_A2F4_A32CD026A911_01_CLIENT_CONFIGURATION_HANDLE
+#define CH_TELEMETRY     ATT_CHARACTERISTIC_0000000B_B0A0_475D_A2F4_A32CD026A911_01_VALUE_HANDLE
+#define CH_TELEMETRY_CFG ATT_CHARACTERISTIC_0000000B_B0A0_475D_A2F4_A32CD026A911_01_CLIENT_CONFIGURATION_HANDLE
+#define CH_TZ_RULE       ATT_CHARACTERISTIC_0000000C_B0A0_475D_A2F4_A32CD026A911_01_VALUE_HANDLE
+#define CH_LEAP_SMEAR    ATT_CHARACTERISTIC_0000000D_B0A0_475D_A2F4_A32CD026A911_01_VALUE_HANDLE
+#define CH_CTS_TIME      ATT_CHARACTERISTIC_ORG_BLUETOOTH_CHARACTERISTIC_CURRENT_TIME_01_VALUE_HANDLE
+#define CH_CTS_TIME_CFG  ATT_CHARACTERISTIC_ORG_BLUETOOTH_CHARACTERISTIC_CURRENT_TIME_01_CLIENT_CONFIGURATION_HANDLE
+#define CH_CTS_LOCAL     ATT_CHARACTERISTIC_ORG_BLUETOOTH_CHARACTERISTIC_LOCAL_TIME_INFORMATION_01_VALUE_HANDLE
 
 extern Config config;
 
@@ -30,11 +49,105 @@ static uint8_t adv_data[] = {
 };
 static_assert(sizeof(adv_data) <= 31, "adv_data too long");  // BLE limitation
 
-static uint16_t time_client_config;
+static uint16_t status_client_config;
+static uint16_t cts_client_config;
+static uint16_t sync_client_config;
+static uint16_t telemetry_client_config;
 static hci_con_handle_t con_handle;
-static uint8_t current_time[19] = {0};  // "YYYY-MM-DD hh:mm:ss"
-static uint32_t time_acc = 0xFFFFFFFF;
-static std::function<void(BLECommand)> command_cb;
+static BLE_Time current_time = {.accuracy_ns = 0xFFFFFFFF};
+static bool     status_pending;
+static bool     cts_pending;  // The time was set or lost, which CTS clients hear about
+static Time_Sync_Server sync_server;
+static uint32_t telemetry_cursor;  // Next record the client hasn't had
+static std::function<void(BLECommand, int32_t, std::string_view)> command_cb;
+
+static bool subscribed(uint16_t client_config)
+{
+	return client_config & GATT_CLIENT_CHARACTERISTICS_CONFIGURATION_NOTIFICATION;
+}
+
+// Telemetry needs more than the default 23 byte MTU; the client has to raise it
+static bool telemetry_waiting()
+{
+	return subscribed(telemetry_client_config) && telemetry_cursor != telemetry_next() &&
+	       att_server_get_mtu(con_handle) - 3 >= Telemetry_History::min_batch;
+}
+
+static bool notify_pending()
+{
+	return (status_pending && subscribed(status_client_config)) || (cts_pending && subscribed(cts_client_config)) ||
+	       telemetry_waiting();
+}
+
+// UTC now from the disciplined timebase, or 0 if the clock doesn't know it
+static int64_t utc_now_us()
+{
+	Clock_State clock = gps_get_clock_state();
+	uint64_t hw_us = time_us_64();
+	if (!clock.valid)
+		return 0;
+	// An inserted second gives 23:59:59 over again, as POSIX time does
+	Time_us utc{std::chrono::microseconds(hw_us + clock.offset_us(hw_us))};
+	bool second_60;
+	if (utc >= clock.leap.start)
+		utc = clock.leap.to_utc(utc, second_60);
+	return utc.time_since_epoch().count();
+}
+
+// Now, in the display's time zone, for the text and CTS characteristics.
+// Read from the timebase, not the last tick, which may be most of a second old.
+static std::optional<Time_us> local_now()
+{
+	using namespace std::chrono;
+	int64_t utc_us = utc_now_us();
+	if (utc_us == 0)
+		return std::nullopt;
+	return Time_us(microseconds(utc_us)) + seconds(current_time.utc_offset_s);
+}
+
+// "YYYY-MM-DD hh:mm:ss", local time, or "no time" until there is one.
+// Returns the length.
+static size_t format_time(uint8_t (&text)[19])
+{
+	std::optional<Time_us> local_us = local_now();
+	if (!local_us)
+		return std::format_to_n(text, sizeof(text), "no time").out - text;
+	Time_Parts time = time_split(*local_us);
+	return std::format_to_n(text, sizeof(text),
+		"{:04}-{:02}-{:02} {:02}:{:02}:{:02}",
+		time.year, time.month, time.day,
+		time.hour, time.minute, time.second).out - text;
+}
+
+// CTS Current Time: Exact Time 256 in local time, then the adjust reason
+static void cts_current_time(uint8_t (&value)[10])
+{
+	memset(value, 0, sizeof(value));  // Year 0 and day of week 0 are "unknown"
+	std::optional<Time_us> local_us = local_now();
+	if (!local_us)
+		return;
+
+	using namespace std::chrono;
+	Time_Parts time = time_split(*local_us);
+	little_endian_store_16(value, 0, time.year);
+	value[2] = time.month;
+	value[3] = time.day;
+	value[4] = time.hour;
+	value[5] = time.minute;
+	value[6] = time.second;
+	value[7] = weekday(floor<days>(*local_us)).iso_encoding();  // Monday is 1
+	value[8] = (*local_us - floor<seconds>(*local_us)).count() * 256 / 1'000'000;  // Fractions256
+	value[9] = 0x02;  // Adjust reason: external reference time update
+}
+
+// BTstack may only be called from its own context, which might be on the
+// other core.  Ticks just flag this worker to run there.
+static void notify_time(async_context_t* context, async_when_pending_worker_t* worker)
+{
+	if (notify_pending())
+		att_server_request_can_send_now_event(con_handle);
+}
+static async_when_pending_worker_t notify_worker = { .do_work = notify_time };
 
 static void packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size) 
 {
@@ -51,6 +164,7 @@ static void packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packe
 		if (btstack_event_state_get_state(packet) != HCI_STATE_WORKING) return;
 		gap_local_bd_addr(local_addr);
 		printf("BTstack up and running on %s.\n", bd_addr_to_str(local_addr));
+		boot_mark(Boot_Phase::BLE_READY);
 
 		// setup advertisements
 		uint16_t adv_int_min = 800;
@@ -72,12 +186,56 @@ static void packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packe
 		gap_advertisements_enable(1);
 		break;
 	}
+	case ATT_EVENT_CONNECTED:
+		// Ask for the longest link layer packets, so a telemetry batch as big as
+		// the client's MTU allows goes out in as few as possible.  Best effort:
+		// if the controller is busy or can't, we just send more packets.
+		hci_send_cmd(&hci_le_set_data_length, att_event_connected_get_handle(packet), 251, 2120);
+		break;
 	case HCI_EVENT_DISCONNECTION_COMPLETE:
-		time_client_config = 0;
+		status_client_config    = 0;
+		cts_client_config       = 0;
+		sync_client_config      = 0;
+		telemetry_client_config = 0;
 		break;
 	case ATT_EVENT_CAN_SEND_NOW:
-		att_server_notify(con_handle, CH_TIME,     current_time,        sizeof(current_time));
-		att_server_notify(con_handle, CH_TIME_ACC, (uint8_t*)&time_acc, sizeof(time_acc));
+		// A sync reply goes out alone, stamped as late as we can, and
+		// anything else waits for the next chance
+		if (sync_server.pending() && subscribed(sync_client_config))
+		{
+			Time_Sync_Response response = sync_server.respond(utc_now_us(), gps_get_time_accuracy_ns());
+			att_server_notify(con_handle, CH_SYNC, (uint8_t*)&response, sizeof(response));
+			if (notify_pending())
+				att_server_request_can_send_now_event(con_handle);
+			break;
+		}
+		// One notification a second with everything in it
+		if ((status_pending && subscribed(status_client_config)) || (cts_pending && subscribed(cts_client_config)))
+		{
+			if (status_pending && subscribed(status_client_config))
+				att_server_notify(con_handle, CH_STATUS, (uint8_t*)&current_time, sizeof(current_time));
+			if (cts_pending && subscribed(cts_client_config))
+			{
+				uint8_t value[10];
+				cts_current_time(value);
+				att_server_notify(con_handle, CH_CTS_TIME, value, sizeof(value));
+			}
+			status_pending = false;
+			cts_pending    = false;
+		}
+		// Then telemetry, one MTU-sized batch per chance until the client has
+		// caught up.  After a subscribe that's the whole hour.
+		else if (telemetry_waiting())
+		{
+			static uint8_t batch[512];  // The longest an attribute value can be
+			uint16_t size   = std::min<uint16_t>(sizeof(batch), att_server_get_mtu(con_handle) - 3);
+			uint32_t cursor = telemetry_cursor;
+			uint32_t used   = telemetry_pack(cursor, std::span(batch, size));
+			if (used && att_server_notify(con_handle, CH_TELEMETRY, batch, used) == ERROR_CODE_SUCCESS)
+				telemetry_cursor = cursor;
+		}
+		if (notify_pending())
+			att_server_request_can_send_now_event(con_handle);
 		break;
 	default:
 		break;
@@ -92,13 +250,58 @@ static uint16_t att_read_callback(hci_con_handle_t connection_handle, uint16_t a
 		switch (att_handle) 
 		{
 		case CH_TIME:
-			return att_read_callback_handle_blob(current_time, sizeof(current_time), offset, buffer, buffer_size);
-		case CH_TIME_CFG:
-			return att_read_callback_handle_little_endian_16(time_client_config, offset, buffer, buffer_size);
+		{
+			uint8_t text[19];
+			size_t length = format_time(text);
+			return att_read_callback_handle_blob(text, length, offset, buffer, buffer_size);
+		}
+		case CH_TIME_ACC:
+			return att_read_callback_handle_little_endian_32(current_time.accuracy_ns, offset, buffer, buffer_size);
+		case CH_STATUS:
+			return att_read_callback_handle_blob((const uint8_t*)&current_time, sizeof(current_time), offset, buffer, buffer_size);
+		case CH_STATUS_CFG:
+			return att_read_callback_handle_little_endian_16(status_client_config, offset, buffer, buffer_size);
+		case CH_CTS_TIME:
+		{
+			uint8_t value[10];
+			cts_current_time(value);
+			return att_read_callback_handle_blob(value, sizeof(value), offset, buffer, buffer_size);
+		}
+		case CH_TELEMETRY_CFG:
+			return att_read_callback_handle_little_endian_16(telemetry_client_config, offset, buffer, buffer_size);
+		case CH_SYNC_CFG:
+			return att_read_callback_handle_little_endian_16(sync_client_config, offset, buffer, buffer_size);
+		case CH_CTS_TIME_CFG:
+			return att_read_callback_handle_little_endian_16(cts_client_config, offset, buffer, buffer_size);
+		case CH_CTS_LOCAL:
+		{	// Standard time's offset in 15 minute steps, then the summer time on top
+			// of it: 0, 2, 4 or 8 for 0, 1/2, 1 or 2 hours, 0xFF if it's none of those
+			int32_t dst_s = current_time.dst_s;
+			uint8_t value[2] = {
+				uint8_t(int8_t((current_time.utc_offset_s - dst_s) / 900)),
+				uint8_t(dst_s == 0 || dst_s == 1800 || dst_s == 3600 || dst_s == 7200 ? dst_s / 900 : 0xFF),
+			};
+			return att_read_callback_handle_blob(value, sizeof(value), offset, buffer, buffer_size);
+		}
+		case CH_TZ_RULE:
+			return att_read_callback_handle_blob((const uint8_t*)config.time_zone_rule,
+				strnlen(config.time_zone_rule, sizeof(config.time_zone_rule)), offset, buffer, buffer_size);
 		case CH_TIME_ZONE:
 			return att_read_callback_handle_little_endian_32(config.time_zone, offset, buffer, buffer_size);
 		case CH_BRIGHT:
 			return att_read_callback_handle_byte(config.brightness, offset, buffer, buffer_size);
+		case CH_LEAP_SMEAR:
+			return att_read_callback_handle_byte(config.leap_smear, offset, buffer, buffer_size);
+		case CH_TIMING:
+		{
+			Timing_Report report = timing_report();
+			return att_read_callback_handle_blob((const uint8_t*)report.data(), sizeof(report), offset, buffer, buffer_size);
+		}
+		case CH_BOOT:
+		{
+			Boot_Report report = boot_report();
+			return att_read_callback_handle_blob((const uint8_t*)report.data(), sizeof(report), offset, buffer, buffer_size);
+		}
 		}
 
 		return 0;
@@ -107,7 +310,6 @@ static uint16_t att_read_callback(hci_con_handle_t connection_handle, uint16_t a
 static int att_write_callback(hci_con_handle_t connection_handle, uint16_t att_handle, 
 	uint16_t transaction_mode, uint16_t offset, uint8_t *buffer, uint16_t buffer_size) 
 {
-		UNUSED(transaction_mode);
 		UNUSED(offset);
 		
 		switch (att_handle) 
@@ -119,20 +321,65 @@ static int att_write_callback(hci_con_handle_t connection_handle, uint16_t att_h
 				switch (command)  // Values are random 32-bit ints
 				{
 				case 0x31a86b97:  // Save settings
-					command_cb(BLECommand::SAVE_SETTINGS);
+					command_cb(BLECommand::SAVE_SETTINGS, 0, {});
 					break;
 				}
 			}
 			break;
-		case CH_TIME_CFG:
-			time_client_config = little_endian_read_16(buffer, 0);
+		case CH_STATUS_CFG:
+			status_client_config = little_endian_read_16(buffer, 0);
+			con_handle = connection_handle;
+			break;
+		case CH_CTS_TIME_CFG:
+			cts_client_config = little_endian_read_16(buffer, 0);
+			con_handle = connection_handle;
+			break;
+		case CH_SYNC:
+			// Stamp it first thing, before anything else can delay it
+			if (sync_server.on_request(std::span(buffer, buffer_size), utc_now_us()))
+			{
+				con_handle = connection_handle;
+				att_server_request_can_send_now_event(con_handle);
+			}
+			break;
+		case CH_SYNC_CFG:
+			sync_client_config = little_endian_read_16(buffer, 0);
+			con_handle = connection_handle;
+			break;
+		case CH_TELEMETRY_CFG:
+			// A new subscriber gets all the history there is, then each second as it comes
+			telemetry_client_config = little_endian_read_16(buffer, 0);
+			telemetry_cursor        = telemetry_oldest();
 			con_handle = connection_handle;
+			if (telemetry_waiting())
+				att_server_request_can_send_now_event(con_handle);
 			break;
 		case CH_TIME_ZONE:
-			config.time_zone = little_endian_read_32(buffer, 0);
+			if (command_cb)
+				command_cb(BLECommand::SET_TIME_ZONE, little_endian_read_32(buffer, 0), {});
 			break;
+		case CH_TZ_RULE:
+		{	// A zone name is stored as its rule, so it reads back as what's in use.
+			// It has to fit the MTU; long writes would arrive in pieces.
+			if (transaction_mode != ATT_TRANSACTION_MODE_NONE)
+				return ATT_ERROR_REQUEST_NOT_SUPPORTED;
+			std::string_view text((const char*)buffer, strnlen((const char*)buffer, buffer_size));
+			if (const char* rule = tz_lookup(text))
+				text = rule;
+			Tz_Rule rule;
+			if (text.size() >= sizeof(config.time_zone_rule) || (!text.empty() && !tz_parse(text, rule)))
+				return ATT_ERROR_VALUE_NOT_ALLOWED;
+			if (command_cb)
+				command_cb(BLECommand::SET_TIME_ZONE_RULE, 0, text);
+			break;
+		}
 		case CH_BRIGHT:
-			config.brightness = buffer[0];
+			if (command_cb)
+				command_cb(BLECommand::SET_BRIGHTNESS, buffer[0], {});
+			break;
+		case CH_LEAP_SMEAR:
+			if (command_cb)
+				command_cb(BLECommand::SET_LEAP_SMEAR, buffer[0], {});
 			break;
 		}
 
@@ -144,6 +391,7 @@ void ble_init()
 	if (cyw43_arch_init()) {
 			printf("failed to initialise cyw43_arch\n");
 	}
+	async_context_add_when_pending_worker(cyw43_arch_async_context(), &notify_worker);
 
 	l2cap_init();
 	sm_init();
@@ -161,31 +409,42 @@ void ble_init()
 	hci_power_control(HCI_POWER_ON);
 }
 
-void ble_tick_time(const Time_Parts& time, uint32_t time_acc)
+void ble_tick_time(const BLE_Time& time)
 {
-	std::format_to_n(current_time, sizeof(current_time), 
-		"{:04}-{:02}-{:02} {:02}:{:02}:{:02}", 
-		time.year, time.month, time.day, 
-		time.hour, time.minute, time.second);
-	::time_acc = time_acc;
-	if (time_client_config & GATT_CLIENT_CHARACTERISTICS_CONFIGURATION_INDICATION)
-		att_server_request_can_send_now_event(con_handle);
+	// Called from a plain thread, while BTstack may be reading these from its
+	// own context
+	async_context_t* context = cyw43_arch_async_context();
+	async_context_acquire_lock_blocking(context);
+	// CTS only notifies when the time is set or lost, not every second
+	if ((time.utc_us != 0) != (current_time.utc_us != 0) || (time.servo == 2) != (current_time.servo == 2))
+		cts_pending = true;
+	current_time   = time;
+	status_pending = true;
+	async_context_set_work_pending(context, &notify_worker);
+	async_context_release_lock(context);
 }
 
-void ble_set_command_cb(std::function<void(BLECommand)> cb)
+void ble_set_command_cb(std::function<void(BLECommand, int32_t, std::string_view)> cb)
 {
 	command_cb = cb;
 }
 
 uint8_t ble_get_id()
 {
+	// Reading the ID takes flash out of XIP mode, which would crash the other
+	// core if it's running from flash.  So read it once, early, and keep it.
+	static bool    have_id = false;
+	static uint8_t id8     = 0;
+	if (have_id)
+		return id8;
+
 	// These IDs seem to have runs in the high and low bytes, so XOR them to get a more unique value
 	uint8_t id[FLASH_UNIQUE_ID_SIZE_BYTES];
 	flash_get_unique_id(id);
 
-	uint8_t id8 = 0;
 	for (int i = 0; i < FLASH_UNIQUE_ID_SIZE_BYTES; ++i)
 		id8 ^= id[i];
 
+	have_id = true;
 	return id8;
 }
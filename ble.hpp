@@ -2,14 +2,33 @@
 #include "time.hpp"
 #include <cstdint>
 #include <string>
+#include <string_view>
 #include <functional>
 
 enum class BLECommand
 {
     SAVE_SETTINGS,
+    SET_TIME_ZONE,   // Value is the offset in hours.  Clears the rule.
+    SET_TIME_ZONE_RULE,  // Text is a valid POSIX TZ rule, or empty to use the hours
+    SET_BRIGHTNESS,  // Value is 0-127
+    SET_LEAP_SMEAR,  // Value is 1 to smear leap seconds, 0 to show 23:59:60
+};
+
+// What the time status characteristic notifies each second, little endian
+struct [[gnu::packed]] BLE_Time
+{
+	int64_t  utc_us;       // UTC of the frame latched with this, us since 1970.  0 if unknown.
+	uint32_t accuracy_ns;
+	uint8_t  fix;          // Receiver fix: 0 none, 2 2D, 3 3D, 5 time only
+	uint8_t  servo;        // 0 no time, 1 set but not locked to PPS, 2 locked
+	int32_t  utc_offset_s; // Local minus UTC, summer time included
+	int32_t  dst_s;        // How much of utc_offset_s is summer time
 };
 
 void  ble_init();
-void  ble_tick_time(const Time_Parts& time, uint32_t time_acc);
-void  ble_set_command_cb(std::function<void(BLECommand)> cb);
+void  ble_tick_time(const BLE_Time& time);
+// Called from the BLE stack's context, which may be the other core.  Settings
+// changes come through here too, so only the callback's core writes config.
+// text is only valid during the call.
+void  ble_set_command_cb(std::function<void(BLECommand, int32_t value, std::string_view text)> cb);
 uint8_t ble_get_id();
\ No newline at end of file
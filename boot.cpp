@@ -0,0 +1,47 @@
+#include "boot.hpp"
+#include "pico/time.h"
+#include <stdio.h>
+#include <algorithm>
+#include <iterator>
+
+static const char* const phase_names[] = {
+	"display",
+	"config",
+	"clock",
+	"ble",
+	"gps",
+	"splash done",
+	"time valid",
+};
+static_assert(std::size(phase_names) == (int)Boot_Phase::COUNT);
+
+// Each is written once, by whoever finishes that phase
+static volatile uint32_t phase_us[(int)Boot_Phase::COUNT];
+
+void boot_mark(Boot_Phase phase)
+{
+	if (phase_us[(int)phase] == 0)
+		phase_us[(int)phase] = std::max<uint64_t>(time_us_64(), 1);
+}
+
+Boot_Report boot_report()
+{
+	Boot_Report report;
+	for (uint i = 0; i < report.size(); i++)
+		report[i] = phase_us[i];
+	return report;
+}
+
+void boot_print()
+{
+	Boot_Report report = boot_report();
+	printf("Boot:");
+	for (uint i = 0; i < report.size(); i++)
+	{
+		if (report[i])
+			printf("  %s %ums", phase_names[i], (uint)(report[i] / 1000));
+		else
+			printf("  %s -", phase_names[i]);
+	}
+	printf("\n");
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+// When each part of bringing the clock up finished, in microseconds since
+// reset.  The parts run side by side: the display starts as soon as the
+// config is loaded, the radio comes up on core 1, and the GPS is configured
+// from the main loop's core while frames go out.
+enum class Boot_Phase
+{
+	DISPLAY_BLANK,   // LED drivers set up and blanked
+	CONFIG_LOADED,   // Settings and warm start state read from flash
+	CLOCK_STARTED,   // Frame alarm running, showing the lamp test
+	BLE_READY,       // Radio up and advertising
+	GPS_CONFIGURED,  // Receiver found and its configuration queued
+	SPLASH_DONE,     // Lamp test over, showing the clock
+	TIME_VALID,      // First valid time from the GPS
+	COUNT
+};
+
+// What the BLE boot characteristic reads: one per Boot_Phase, little
+// endian, 0 if it hasn't happened yet
+using Boot_Report = std::array<uint32_t, (int)Boot_Phase::COUNT>;
+
+// Record that a phase is done.  Only the first call for each counts.  Safe
+// from any core or interrupt.
+void boot_mark(Boot_Phase phase);
+Boot_Report boot_report();
+void boot_print();
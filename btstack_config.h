@@ -6,16 +6,19 @@
 
 // BTstack features that can be enabled
 #define ENABLE_LE_PERIPHERAL
-#define ENABLE_LOG_INFO
 #define ENABLE_LOG_ERROR
 #define ENABLE_PRINTF_HEXDUMP
+// Longer link layer packets, for telemetry batches
+#define ENABLE_LE_DATA_LENGTH_EXTENSION
 
 // for the client
 #define MAX_NR_GATT_CLIENTS 0
 
 // BTstack configuration. buffers, sizes, ...
 #define HCI_OUTGOING_PRE_BUFFER_SIZE 4
-#define HCI_ACL_PAYLOAD_SIZE (255 + 4)
+// Room for an ATT MTU of 517, the most a client can ask for, so a telemetry
+// batch is one notification.  HCI splits it to the link's data length.
+#define HCI_ACL_PAYLOAD_SIZE (517 + 4)
 #define HCI_ACL_CHUNK_SIZE_ALIGNMENT 4
 #define MAX_NR_HCI_CONNECTIONS 1
 #define MAX_NR_SM_LOOKUP_ENTRIES 3
@@ -0,0 +1,84 @@
+#include "clock_servo.hpp"
+#include <algorithm>
+#include <cstdlib>
+
+int32_t Clock_Servo::drift_ppb() const
+{
+	return -((freq_q32 * 1'000'000'000) >> 32);
+}
+
+void Clock_Servo::set_drift_ppb(int32_t drift_ppb)
+{
+	freq_q32 = std::clamp(-(int64_t(drift_ppb) << 32) / 1'000'000'000, -max_freq_q32, max_freq_q32);
+}
+
+void Clock_Servo::step(uint64_t hw_us, int64_t utc_us)
+{
+	step(hw_us, utc_us, 0);
+}
+
+void Clock_Servo::step(uint64_t hw_us, int64_t utc_us, int64_t adjust_q32)
+{
+	clock.ref_hw_us  = hw_us;
+	clock.phase_us   = utc_us - hw_us + (adjust_q32 >> 32);
+	clock.phase_frac = uint32_t(adjust_q32);
+	clock.rate_q32   = freq_q32;
+	is_valid         = true;
+	good_edges       = 0;
+}
+
+void Clock_Servo::reset()
+{
+	is_valid   = false;
+	good_edges = 0;
+}
+
+void Clock_Servo::on_pps(uint64_t pps_hw_us, int64_t utc_us, uint32_t pps_frac, int32_t qerr_ps)
+{
+	if (is_valid && pps_hw_us == clock.ref_hw_us)
+		return;  // Already have this edge
+
+	// The edge came pps_frac after pps_hw_us, which makes the offset that
+	// much smaller.  The true second was qerr_ps before it, which makes it
+	// that much larger.
+	int64_t adjust_q32 = (int64_t(qerr_ps) << 32) / 1'000'000 - pps_frac;
+
+	int64_t interval_us = pps_hw_us - clock.ref_hw_us;
+	if (!is_valid || interval_us < 0 || interval_us > 4'000'000)
+	{	// Nothing recent to compare against
+		step(pps_hw_us, utc_us, adjust_q32);
+		return;
+	}
+
+	// Where the timebase says we are at this edge
+	int64_t  predicted   = int64_t(clock.phase_frac) + interval_us * clock.rate_q32;
+	int64_t  pred_us     = clock.phase_us + (predicted >> 32);
+	uint32_t pred_frac   = uint32_t(predicted);
+
+	int64_t error_us = (utc_us - int64_t(pps_hw_us)) - pred_us;
+	if (std::abs(error_us) > step_threshold_us)
+	{	// Too far out to slew in reasonable time
+		last_error = std::clamp<int64_t>(error_us * 1000, INT32_MIN, INT32_MAX);
+		step(pps_hw_us, utc_us, adjust_q32);
+		return;
+	}
+
+	int64_t error_q32 = (error_us << 32) + adjust_q32 - pred_frac;
+	last_error = (error_q32 * 1000) >> 32;
+
+	// PI servo.  The integral term tracks the crystal's frequency error, and
+	// the proportional term slews out the phase error over the next interval.
+	int64_t error_rate_q32 = error_q32 / interval_us;
+	freq_q32 = std::clamp(freq_q32 + (error_rate_q32 >> ki_shift), -max_freq_q32, max_freq_q32);
+
+	// Carry on from where the timebase actually was, so there's no jump
+	clock.ref_hw_us  = pps_hw_us;
+	clock.phase_us   = pred_us;
+	clock.phase_frac = pred_frac;
+	clock.rate_q32   = freq_q32 + (error_rate_q32 >> kp_shift);
+
+	if (std::abs(error_q32) <= (lock_threshold_us << 32))
+		good_edges = std::min(good_edges + 1, lock_edges);
+	else
+		good_edges = 0;
+}
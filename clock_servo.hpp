@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdint>
+
+// Maps hardware time to UTC: a phase at a reference time, and a rate since
+struct Clock_Model
+{
+	uint64_t ref_hw_us  = 0;  // Hardware time the phase was taken at
+	int64_t  phase_us   = 0;  // Offset at ref_hw_us...
+	uint32_t phase_frac = 0;  // ...plus this many 2^-32 us
+	int64_t  rate_q32   = 0;  // Offset change per us, in units of 2^-32
+
+	// UTC minus hardware time, as of hardware time hw_us
+	int64_t offset_us(uint64_t hw_us) const
+	{
+		// Fixed point, so the per-frame cost is a multiply and shift
+		int64_t elapsed_us = hw_us - ref_hw_us;
+		return phase_us + ((int64_t(phase_frac) + elapsed_us * rate_q32) >> 32);
+	}
+};
+
+// Disciplines the hardware timer to GPS PPS edges.  Each edge is paired with
+// the UTC time it marks, and a PI servo estimates the crystal's frequency error.
+// Small errors are slewed out over the following seconds instead of stepped,
+// so the displayed time never jumps.  Doesn't touch hardware, so it can be
+// driven by a simulation on the host.
+//
+// The timer only counts whole microseconds, so phase and rate carry a 2^-32 us
+// fraction.  That keeps sub-microsecond corrections like the receiver's
+// quantization error from being rounded away.
+struct Clock_Servo
+{
+	// A PPS edge at hardware time pps_hw_us, plus pps_frac 2^-32 us, marked
+	// UTC time utc_us (both in us).  qerr_ps is the receiver's quantization
+	// error for that edge, if known: the edge came qerr_ps later than the
+	// true second.
+	void on_pps(uint64_t pps_hw_us, int64_t utc_us, uint32_t pps_frac = 0, int32_t qerr_ps = 0);
+	// Set the timebase outright, from a source without a PPS edge
+	void step(uint64_t hw_us, int64_t utc_us);
+	// Move the timebase by a whole amount, e.g. onto UTC after a leap second.
+	// The frequency estimate and lock carry on as they were.
+	void shift(int64_t us) { clock.phase_us += us; }
+	// Forget the time, but keep the frequency estimate
+	void reset();
+	// Start from a known frequency error, e.g. remembered from last time
+	void set_drift_ppb(int32_t drift_ppb);
+
+	bool    valid()  const { return is_valid; }
+	bool    locked() const { return good_edges >= lock_edges; }
+	// UTC minus hardware time, as of hardware time hw_us
+	int64_t offset_us(uint64_t hw_us) const { return clock.offset_us(hw_us); }
+	const Clock_Model& model() const { return clock; }
+	// Estimated crystal frequency error.  Positive means the crystal runs fast.
+	int32_t drift_ppb() const;
+	// Phase error measured at the last PPS edge, before it was corrected
+	int32_t last_error_ns() const { return last_error; }
+
+private:
+	static constexpr int64_t step_threshold_us = 1000;    // Bigger errors are stepped, not slewed
+	static constexpr int64_t lock_threshold_us = 20;
+	static constexpr int     lock_edges        = 4;       // Consecutive good edges to call it locked
+	static constexpr int64_t max_freq_q32      = 2'147'484; // 500ppm, far beyond any working crystal
+	static constexpr int     kp_shift          = 1;       // Proportional gain 1/2
+	static constexpr int     ki_shift          = 4;       // Integral gain 1/16
+
+	// step(), with the offset adjust_q32 2^-32 us larger
+	void step(uint64_t hw_us, int64_t utc_us, int64_t adjust_q32);
+
+	bool        is_valid   = false;
+	Clock_Model clock;
+	int64_t     freq_q32   = 0;  // Integrated frequency correction, in 2^-32 us per us
+	int32_t  last_error = 0;
+	int      good_edges = 0;
+};
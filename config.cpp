@@ -1,35 +1,43 @@
 #include "config.hpp"
+#include "flash_log.hpp"
 #include <boards/pico_w.h>
 #include <hardware/flash.h>
-#include <hardware/sync.h>
-#include <utility>
 #include <algorithm>
+#include <cstddef>
 #include <cstring>
 
-extern uint32_t* __flash_binary_end;
+// BTstack keeps its pairing data in the last two sectors, so the config log
+// goes in the four below them
+static constexpr uint32_t btstack_sectors = 2;
+static constexpr uint32_t config_sectors  = 4;
+static Flash_Log store(PICO_FLASH_SIZE_BYTES - (btstack_sectors + config_sectors) * FLASH_SECTOR_SIZE, config_sectors);
 
-// Let's use the very last sector of flash memory for configuration storage
-static const uint32_t config_flash_start = PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE;
-static uint8_t* const config_flash_addr  = (uint8_t*)config_flash_start + XIP_BASE;
+// Store keys
+static constexpr uint8_t key_config     = 0;
+static constexpr uint8_t key_warm_state = 1;
 
-struct Record
+// Before the log, a bare {magic, Config} was appended to the last sector
+static const uint8_t* const legacy_flash_addr = (const uint8_t*)XIP_BASE + PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE;
+static constexpr uint32_t legacy_magic = 0xddccc2fe;
+
+struct [[gnu::packed]] Legacy_Record
 {
 	uint32_t magic;
-	Config   config;
+	int32_t  time_zone;
+	uint8_t  brightness;
+	uint8_t  padding[3];
 };
 
-static const int num_pages = FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE;
-static const int records_per_page = FLASH_PAGE_SIZE / sizeof(Record);
-
-static Record* find_last_record()
+static const Legacy_Record* find_last_legacy_record()
 {
-	Record* last_record = nullptr;
-	for (int ipage = 0; ipage < num_pages; ipage++)
+	static const int records_per_page = FLASH_PAGE_SIZE / sizeof(Legacy_Record);
+	const Legacy_Record* last_record = nullptr;
+	for (uint32_t ipage = 0; ipage < FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE; ipage++)
 	{
-		Record *page_records = (Record*)(config_flash_addr + ipage * FLASH_PAGE_SIZE);
+		const Legacy_Record* page_records = (const Legacy_Record*)(legacy_flash_addr + ipage * FLASH_PAGE_SIZE);
 		for (int irecord = 0; irecord < records_per_page; irecord++)
 		{
-			if (page_records[irecord].magic == Config::magic)
+			if (page_records[irecord].magic == legacy_magic)
 				last_record = &page_records[irecord];  // Looks like a valid record, remember it
 			else
 				return last_record;  // No more valid records
@@ -38,74 +46,77 @@ static Record* find_last_record()
 	return last_record;
 }
 
-void config_read_from_flash(Config &config)
+// Version 1 of Config, which the compiler padded
+struct Config_V1
 {
-	Record* last_record = find_last_record();
+	int32_t time_zone;
+	uint8_t brightness;
+	char    time_zone_rule[40];
+	uint8_t leap_smear;
+};
 
-	// Fill the configuration
-	if (last_record)
-		config = last_record->config;
-	else
+// The first version 1 records were only time_zone and brightness, and
+// anything past that is whatever the padding held
+static void convert_v1(std::span<const uint8_t> payload, Config& config)
+{
+	Config_V1 v1 = {};
+	memcpy(&v1, payload.data(), std::min(payload.size(), sizeof(v1)));
+	config.time_zone  = v1.time_zone;
+	config.brightness = v1.brightness;
+	if (payload.size() >= offsetof(Config_V1, time_zone_rule) + sizeof(v1.time_zone_rule) + 1)
 	{
-		// Default values
-		config.time_zone  = 0;
-		config.brightness = 64;
+		memcpy(config.time_zone_rule, v1.time_zone_rule, sizeof(config.time_zone_rule));
+		config.time_zone_rule[sizeof(config.time_zone_rule) - 1] = 0;
+		config.leap_smear = v1.leap_smear == 1;
 	}
 }
 
-static std::pair<int, int> find_empty_slot()
+void config_init()
 {
-	// Find the first empty space for a new record
-	// Iterating by page and record because we want to avoid records 
-	// straddling pages and requiring two programs to write.
-	for (int ipage = 0; ipage < num_pages; ipage++)
-	{
-		Record *page_records = (Record*)(config_flash_addr + ipage * FLASH_PAGE_SIZE);
-		for (int irecord = 0; irecord < records_per_page; irecord++)
-		{
-			Record* record = &page_records[irecord];
-			if (record->magic == Config::magic)
-				continue;  // Looks like a valid record, skip over it
-			else if (std::all_of((uint8_t*)record, (uint8_t*)record + sizeof(Record), [](uint8_t byte) { return byte == 0xff; }))
-			{	// Found an empty slot
-				return {ipage, irecord};
-			}
-			else
-			{ // Not valid, and not empty.  We'd better erase and start fresh.
-				return {-1, -1};
-			}
-		}
-	}
-
-	// No empty slot found
-	return {-1, -1};
+	store.init();
 }
 
-void config_write_to_flash(const Config &config)
-{	
-	auto [ipage, irecord] = find_empty_slot();
+void config_read_from_flash(Config &config)
+{
+	config = Config();
 
-	// If we didn't find an empty slot, erase the whole sector.
-	// This just resets all bits to one.  Programming turns them to zero.
-	if (ipage == -1)
+	uint8_t version;
+	std::span<const uint8_t> payload;
+	if (store.read(key_config, version, payload))
 	{
-		flash_range_erase(config_flash_start, FLASH_SECTOR_SIZE);
-		ipage = 0;
-		irecord = 0;
+		// Can't know what a newer layout means, so stick with the defaults
+		if (version == 1)
+			convert_v1(payload, config);
+		else if (version <= Config::version)
+			memcpy(&config, payload.data(), std::min(payload.size(), sizeof(Config)));
 	}
-	
-	// No interrupts during flashing
-	uint32_t ints = save_and_disable_interrupts();
+	else if (const Legacy_Record* legacy = find_last_legacy_record())
+	{	// Carry it over, since BTstack may reuse that sector
+		config.time_zone  = legacy->time_zone;
+		config.brightness = legacy->brightness;
+		config_write_to_flash(config);
+	}
+}
+
+void config_write_to_flash(const Config &config)
+{
+	static_assert(sizeof(Config) <= Flash_Log::max_payload);
+	store.write(key_config, Config::version, std::span((const uint8_t*)&config, sizeof(config)));
+}
 
-	// Write the record.  We have to write a whole page at a time,
-	// but only the zero bits will have any effect.  So we can just
-	// write a page of ones except for the record we want to write.
-	uint8_t page_buffer[FLASH_PAGE_SIZE];
-	memset(page_buffer, 0xff, sizeof(page_buffer));
-	Record* record = (Record*)(page_buffer + irecord * sizeof(Record));
-	record->magic  = Config::magic;
-	record->config = config;
-	flash_range_program(config_flash_start + ipage * FLASH_PAGE_SIZE, page_buffer, FLASH_PAGE_SIZE);
+bool config_read_warm_state(Warm_State& state)
+{
+	uint8_t version;
+	std::span<const uint8_t> payload;
+	if (!store.read(key_warm_state, version, payload) || version > Warm_State::version)
+		return false;
+	state = Warm_State();
+	memcpy(&state, payload.data(), std::min(payload.size(), sizeof(Warm_State)));
+	return true;
+}
 
-	restore_interrupts(ints);
+void config_write_warm_state(const Warm_State& state)
+{
+	static_assert(sizeof(Warm_State) <= Flash_Log::max_payload);
+	store.write(key_warm_state, Warm_State::version, std::span((const uint8_t*)&state, sizeof(state)));
 }
@@ -1,13 +1,44 @@
 #pragma once
 #include <cstdint>
+#include <type_traits>
 
 struct Config
 {
-	static const uint32_t magic = 0xddccc2fe;  // Random
-	// If you change this struct, you must also change the magic!
-	int32_t time_zone;
-	uint8_t brightness;
+	// Saved records carry this.  Only ever add fields at the end; older,
+	// shorter records then load with the defaults for the new ones.  Bump it
+	// if a field's meaning changes, and convert the old one when loading.
+	// There's no padding, so a field can't be added where an older record
+	// has whatever padding held; new ones take the place of reserved bytes
+	// or go after them.
+	//   1: time_zone, brightness, time_zone_rule, leap_smear, with padding
+	//      after brightness that time_zone_rule then moved into
+	static const uint8_t version = 2;
+	int32_t time_zone  = 0;   // Hours from UTC, when there's no rule
+	uint8_t brightness = 64;
+	uint8_t leap_smear = 0;   // 1 to smear leap seconds over a day, 0 to show 23:59:60
+	uint8_t reserved[2] = {};
+	char    time_zone_rule[40] = {};  // POSIX TZ rule, NUL terminated, or empty.  See time_zone.hpp.
 };
+static_assert(std::has_unique_object_representations_v<Config>, "Config has padding");
 
+// What's worth knowing at boot to get the time back sooner.  Saved now and
+// then while the clock is locked.  Same versioning rules as Config.
+struct Warm_State
+{
+	static const uint8_t version = 1;
+	int64_t  utc_us      = 0;  // Last known UTC, us since 1970
+	int32_t  drift_ppb   = 0;  // Crystal frequency error, as Clock_Servo has it
+	uint32_t fingerprint = 0;  // Of the receiver configuration, 0 if it didn't all take
+	uint32_t baud        = 0;  // That configuration moved the receiver to
+	int8_t   leap_s      = 0;  // GPS time minus UTC
+	uint8_t  reserved[3] = {};  // Padding in version 1 records, so a field here needs a new version
+};
+static_assert(std::has_unique_object_representations_v<Warm_State>, "Warm_State has padding");
+
+// Index the config store.  Call once at boot, before the other core starts.
+void config_init();
 void config_read_from_flash(Config& config);
-void config_write_to_flash(const Config& config);
\ No newline at end of file
+void config_write_to_flash(const Config& config);
+// Returns false, leaving state alone, if none was saved
+bool config_read_warm_state(Warm_State& state);
+void config_write_warm_state(const Warm_State& state);
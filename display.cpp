@@ -1,27 +1,133 @@
 #include "display.hpp"
 #include "pico/stdlib.h"
+#include "hardware/clocks.h"
 #include "hardware/dma.h"
+#include "hardware/sync.h"
 #include "tlc5952.pio.h"
+#include "timing.hpp"
+#include <algorithm>
 
 static constexpr uint pio_sm    = 0;
 static constexpr uint num_chips = 6;
 
+using Frame = std::array<uint32_t, num_chips*2>;
+
+// Flag bits above each 25-bit TLC5952 command
+static constexpr uint32_t cmd_brightness = 0x01'000000;  // Select: brightness, not on/off
+static constexpr uint32_t cmd_latch      = 0x02'000000;  // PIO latches after this word
+
 static PIO  pio;
 static uint pio_offset;
-// 2 commands per chip; brightness and on/off
-static std::array<uint32_t, num_chips*2> command_buffer;
+static uint bit_rate;
+// 2 commands per chip; brightness and on/off.  This is the frame being
+// built; disp_send copies it out, so it can be edited at any time.
+static Frame command_buffer;
 static int dma_channel;
+// The frame as it was before the millisecond digits were added, reused for a whole second
+static Frame frame_template;
+static uint32_t dma_start_cycles;
+
+// Frames handed to DMA.  The front one is being sent; the back one waits
+// for the DMA-complete interrupt to swap it in.
+static std::array<Frame, 2> frames;
+static uint          front_frame;
+static bool          back_pending;
+static bool          back_brightness;  // The back frame has new brightness, so send all of it
+// Brightness commands the chips have, or will once the queued frames are out.
+// Zero never matches, since real ones have the select bit set.
+static std::array<uint32_t, num_chips> brightness_sent;
+static volatile bool front_done = true;  // DMA finished with the front frame
+static uint32_t      overruns;
+
+static constexpr uint32_t dp_bit = 0x000001;
+static constexpr std::array<uint8_t, 16> digit_bits = {
+	0xEE, // 0
+	0x82, // 1
+	0xDC, // 2       _40_
+	0xD6, // 3   20 |    | 80
+	0xB2, // 4      |_10_|
+	0x76, // 5   08 |    | 02
+	0x7E, // 6      |_04_|   O 01
+	0xC2, // 7
+	0xFE, // 8
+	0xF6, // 9
+	0xFA, // A
+	0x3E, // b
+	0x1C, // c
+	0x9E, // d
+	0x7C, // E
+	0x78, // F
+};
+
+// Segment bits of the last chip (digits 15-17) for every millisecond
+static constexpr auto ms_segments = [] {
+	std::array<uint32_t, 1000> table{};
+	for (uint ms = 0; ms < table.size(); ms++)
+		table[ms] = digit_bits[ms / 100]      |
+		            digit_bits[ms / 10 % 10] <<  8 |
+		            digit_bits[ms      % 10] << 16;
+	return table;
+}();
+
+// The TLC5952 supplies less current to the blue channels, so we need to
+// slightly dim red and green to compensate.  In 256ths.
+static constexpr uint32_t brightness_rg_scale = 225;  // 0.88, experimentally determined
+
+// Brightness command for every setting, so there's no arithmetic per change
+static constexpr auto brightness_commands = [] {
+	std::array<uint32_t, 256> table{};
+	for (uint bright = 0; bright < table.size(); bright++)
+	{
+		uint32_t b  = std::clamp<uint32_t>(bright, 1, 127);
+		uint32_t rg = std::clamp<uint32_t>(bright * brightness_rg_scale >> 8, 1, 127);
+		table[bright] = cmd_brightness |
+			b  << 14 |  // Bright B 0-127
+			rg <<  7 |  // Bright G 0-127
+			rg;         // Bright R 0-127
+	}
+	return table;
+}();
+
+// Swap to the back frame and start sending it.  Interrupts must be off.
+static void start_back_frame()
+{
+	front_frame  ^= 1;
+	back_pending  = false;
+	front_done    = false;
+	dma_start_cycles = timing_cycles();
 
-void disp_init(PIO pio, uint tx_pin, uint clk_pin, uint latch_pin)
+	// The chips keep their brightness, so usually only the on/off half goes
+	uint skip = back_brightness ? 0 : num_chips;
+	dma_channel_set_trans_count(dma_channel, num_chips*2 - skip, false);
+	dma_channel_set_read_addr(dma_channel, frames[front_frame].data() + skip, true);
+}
+
+// The last word is in the PIO FIFO, though the chain is still a few words from done
+static void dma_isr()
+{
+	dma_channel_acknowledge_irq0(dma_channel);
+	timing_end(Timing::DISP_DMA, dma_start_cycles);
+
+	// Forget the stall waiting for this frame.  Clearing it any earlier,
+	// before the first word arrived, it would only have been set again.  If
+	// the state machine's already stalled on the end of it, it still is.
+	pio->fdebug = 1u << (PIO_FDEBUG_TXSTALL_LSB + pio_sm);  // Write to clear
+	front_done  = true;
+	if (back_pending)
+		start_back_frame();
+}
+
+void disp_init(PIO pio, uint tx_pin, uint clk_pin, uint latch_pin, uint bit_rate)
 {
 	::pio = pio;
+	::bit_rate = bit_rate;
 
 	gpio_init(latch_pin);
 	gpio_set_dir(latch_pin, true);
 	gpio_put(latch_pin, false);
 
 	pio_offset = pio_add_program(pio, &tlc5952_write_program);
-	tlc5952_write_program_init(pio, pio_sm, pio_offset, tx_pin, clk_pin, latch_pin);
+	tlc5952_write_program_init(pio, pio_sm, pio_offset, tx_pin, clk_pin, latch_pin, bit_rate);
 
 	dma_channel = dma_claim_unused_channel(true);
 	dma_channel_config dma_config = dma_channel_get_default_config(dma_channel);
@@ -34,38 +140,77 @@ void disp_init(PIO pio, uint tx_pin, uint clk_pin, uint latch_pin)
 		num_chips*2,        // Transfer count: 2 commands per chip
 		false               // Don't trigger yet
 	);
+
+	dma_channel_set_irq0_enabled(dma_channel, true);
+	irq_set_exclusive_handler(DMA_IRQ_0, dma_isr);
+	irq_set_enabled(DMA_IRQ_0, true);
+}
+
+#if !PICO_ON_DEVICE
+void disp_set_bit_rate(uint bit_rate)
+{
+	::bit_rate = bit_rate;
+	pio_sm_set_clkdiv(pio, pio_sm, clock_get_hz(clk_sys) / (2.0f * bit_rate));  // Two instructions per bit
+}
+#endif
+
+uint32_t disp_frame_time_ns(bool with_brightness)
+{
+	// PIO runs at twice the bit rate
+	uint words = with_brightness ? num_chips*2 : num_chips;
+	return uint64_t(words) * tlc5952_write_cycles_per_word * 500'000'000 / bit_rate;
+}
+
+bool disp_frame_done()
+{
+	// The state machine stalls on an empty FIFO once it's shifted the last bit out
+	return front_done && !back_pending && (pio->fdebug & (1u << (PIO_FDEBUG_TXSTALL_LSB + pio_sm)));
 }
 
-void disp_latch()
+bool disp_latch()
 {
+	// Latching mid-shift would show a mix of two frames, and throw off the
+	// rest of the shift.  Leave the last frame up a little longer instead.
+	if (!disp_frame_done())
+	{
+		overruns++;
+		return false;
+	}
 	pio_sm_exec(pio, pio_sm, pio_encode_jmp(pio_offset + tlc5952_write_offset_latch));
+	return true;
+}
+
+uint32_t disp_overruns()
+{
+	return overruns;
 }
 
 void disp_send(bool latch)
 {
+	uint32_t ints = save_and_disable_interrupts();
+	Frame& back = frames[front_frame ^ 1];
+	back = command_buffer;
 	if (latch)
-		command_buffer[num_chips*2-1] |= 0x02'000000;  // Set flag to latch after the last chip
-	dma_channel_set_read_addr(dma_channel, command_buffer.data(), true);  // Start DMA transfer
+		back[num_chips*2-1] |= cmd_latch;  // Latch after the last chip
+
+	// Only shift brightness when it's changed.  If this replaces a queued
+	// frame that had new brightness, it still has to go.
+	bool new_brightness = !std::equal(brightness_sent.begin(), brightness_sent.end(), command_buffer.begin());
+	if (new_brightness)
+		std::copy_n(command_buffer.begin(), num_chips, brightness_sent.begin());
+	back_brightness = new_brightness || (back_pending && back_brightness);
+	back_pending    = true;
+	if (front_done)
+		start_back_frame();  // Otherwise the DMA interrupt will, when the front frame is out
+	restore_interrupts(ints);
 }
 
 void disp_set_brightness(uint8_t bright)
 {
-	// The TLC5952 supplies less current to the blue channels,
-	// so we need to slightly dim red and green to compensate.
-	uint8_t brightRG = bright * 0.88f;  // Experimentally determined
-	bright   = std::clamp<uint8_t>(bright,   1, 127);
-	brightRG = std::clamp<uint8_t>(brightRG, 1, 127);
+	std::fill_n(command_buffer.begin(), num_chips, brightness_commands[bright]);
 
-	for (int i = 0; i < num_chips; i++)
-	{
-		command_buffer[i] = 0x01'000000 |
-			bright   << 14 |  // Bright B 0-127
-			brightRG <<  7 |  // Bright G 0-127
-			brightRG;         // Bright R 0-127
-	}
-
-	// Set flag to latch after the last chip
-	command_buffer[num_chips-1] |= 0x02'000000;
+	// Latch after the last chip, so they're all in before the on/off half follows
+	command_buffer[num_chips-1] |= cmd_latch;
 }
 
 void disp_clear()
@@ -76,30 +221,24 @@ void disp_clear()
 
 void disp_set_num(uint digit, uint8_t value, bool dp)
 {
-	static constexpr uint32_t dp_bit = 0x000001;
-	static constexpr std::array<uint8_t, 16> digit_bits = {
-		0xEE, // 0
-		0x82, // 1
-		0xDC, // 2       _40_
-		0xD6, // 3   20 |    | 80
-		0xB2, // 4      |_10_|
-		0x76, // 5   08 |    | 02
-		0x7E, // 6      |_04_|   O 01
-		0xC2, // 7
-		0xFE, // 8
-		0xF6, // 9
-		0xFA, // A
-		0x3E, // b
-		0x1C, // c
-		0x9E, // d
-		0x7C, // E
-		0x78, // F
-	};
-
 	uint8_t leds = digit_bits[value] | (dp ? dp_bit : 0);
 	disp_set_raw(digit, leds);
 }
 
+void disp_frame_store()
+{
+	frame_template = command_buffer;
+}
+
+void disp_frame_load(uint millisecond, uint ms_digits)
+{
+	// Mask off the least significant digits we aren't showing
+	static constexpr std::array<uint32_t, 4> digit_masks = {0x000000, 0x0000FF, 0x00FFFF, 0xFFFFFF};
+
+	command_buffer = frame_template;
+	command_buffer[num_chips*2-1] |= ms_segments[millisecond] & digit_masks[ms_digits];
+}
+
 void disp_set_raw(uint digit, uint8_t value)
 {
 	uint chip   = digit / 3;
@@ -5,12 +5,32 @@
 #include <string_view>
 #include "hardware/pio.h"
 
-void disp_init(PIO pio, uint tx_pin, uint clk_pin, uint latch_pin);
-void disp_latch();
+// bit_rate is the shift clock.  The TLC5952 takes up to 35MHz, though the
+// board's wiring may not.
+void disp_init(PIO pio, uint tx_pin, uint clk_pin, uint latch_pin, uint bit_rate = 1'000'000);
+#if !PICO_ON_DEVICE
+// Change the shift clock, so the host bench can compare rates in one run.
+// The firmware sets it once, in disp_init.
+void disp_set_bit_rate(uint bit_rate);
+#endif
+// How long shifting out a frame takes at the current bit rate.  Brightness
+// is only sent when it changes, which doubles the length of that frame.
+uint32_t disp_frame_time_ns(bool with_brightness = false);
+// Latch the last frame sent, if it's all been shifted out.  Returns false,
+// and counts an overrun, if it hasn't.
+bool disp_latch();
+// Whether the last frame sent has been completely shifted out
+bool disp_frame_done();
+uint32_t disp_overruns();
+// Queue the frame for sending; it starts once the one before it is out
 void disp_send(bool latch);
 void disp_set_brightness(uint8_t bright);
 void disp_clear();
 void disp_set_num(uint digit, uint8_t value, bool dp);
 void disp_set_raw(uint chip, uint8_t value);
 void disp_set_colons(bool on);
+// Save the frame built so far (everything but the milliseconds) for reuse
+void disp_frame_store();
+// Restore the stored frame and add the first ms_digits (0-3) digits of millisecond
+void disp_frame_load(uint millisecond, uint ms_digits);
 void disp_test();
\ No newline at end of file
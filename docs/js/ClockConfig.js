@@ -4,8 +4,14 @@ class ClockConfig {
 		this._chCommand  = null;
 		this._chTimeZone = null;
 		this._chBright   = null;
-		this._boundHandleChNotifyTime    = this._handleChNotifyTime.bind(this);
-		this._boundHandleChNotifyTimeAcc = this._handleChNotifyTimeAcc.bind(this);
+		this._chTzRule   = null;
+		this._chLeapSmear = null;
+		this._chSync     = null;
+		this._syncWaiting = null;
+		this._timeZone   = 0;
+		this._boundHandleChNotifyStatus  = this._handleChNotifyStatus.bind(this);
+		this._boundHandleChNotifySync    = this._handleChNotifySync.bind(this);
+		this._boundHandleChNotifyTelemetry = this._handleChNotifyTelemetry.bind(this);
 		this._boundHandleDisconnect      = this._handleDisconnect.bind(this);
 	}
 
@@ -19,14 +25,72 @@ class ClockConfig {
 	_onDisconnected() {
 	}
 
-	_handleChNotifyTime(event) {
-		const time = new TextDecoder().decode(event.target.value);
+	// Time status: int64 UTC us, uint32 accuracy ns, uint8 fix, uint8 servo
+	// state, then from clocks with time zone rules int32 local minus UTC in
+	// seconds and int32 how much of that is summer time
+	_gotStatus(value) {
+		const utcUs    = value.getBigInt64(0, true);
+		const accuracy = value.getUint32(8, true);
+		const fix      = value.getUint8(12);
+		const servo    = value.getUint8(13);
+		const offsetS  = value.byteLength >= 22 ? value.getInt32(14, true) : this._timeZone * 3600;
+
+		let time = '';
+		if (utcUs !== 0n) {
+			// Shown in the clock's time zone, like the display
+			const localMs = Number(utcUs / 1000n) + offsetS * 1000;
+			time = new Date(localMs).toISOString().slice(0, 19).replace('T', ' ');
+		}
 		this._onGotValue('Time', time);
+		this._onGotValue('TimeAccuracy', accuracy);
+		this._onGotValue('Status', {fix: fix, servo: servo});
+	}
+
+	_handleChNotifyStatus(event) {
+		this._gotStatus(event.target.value);
 	}
 
-	_handleChNotifyTimeAcc(event) {
-		const timeAcc = event.target.value.getUint32(0, true);
-		this._onGotValue('TimeAccuracy', timeAcc);
+	// Sync reply: uint32 sequence, int64 client transmit us, int64 receive us,
+	// int64 transmit us, uint32 accuracy ns.  Stamped here on arrival.
+	_handleChNotifySync(event) {
+		const clientRx = this._nowUs();
+		const value    = event.target.value;
+		if (!this._syncWaiting || value.getUint32(0, true) !== this._syncWaiting.sequence) {
+			return;
+		}
+		this._syncWaiting.resolve({
+			clientTx: value.getBigInt64(4, true),
+			receive:  value.getBigInt64(12, true),
+			transmit: value.getBigInt64(20, true),
+			accuracy: value.getUint32(28, true),
+			clientRx: clientRx,
+		});
+	}
+
+	// Telemetry batch: uint32 number of the first record, then 21-byte records
+	_handleChNotifyTelemetry(event) {
+		const value   = event.target.value;
+		const first   = value.getUint32(0, true);
+		const records = [];
+		for (let offset = 4; offset + 21 <= value.byteLength; offset += 21) {
+			const state = value.getUint8(offset + 20);
+			records.push({
+				number:       first + records.length,
+				time:         value.getUint32(offset, true),
+				errorNs:      value.getInt32(offset + 4, true),
+				driftPpb:     value.getInt32(offset + 8, true),
+				accuracyNs:   value.getUint32(offset + 12, true),
+				ppsLatencyUs: value.getUint16(offset + 16, true),
+				frameLateUs:  value.getUint16(offset + 18, true),
+				fix:          state & 0x0f,
+				servo:        state >> 4,
+			});
+		}
+		this._onGotValue('Telemetry', records);
+	}
+
+	_nowUs() {
+		return BigInt(Math.round((performance.timeOrigin + performance.now()) * 1000));
 	}
 
 	_handleDisconnect(event) {
@@ -55,24 +119,30 @@ class ClockConfig {
 
 		this._log('Finding characteristics...');
 		this._chCommand  = await service.getCharacteristic('00000002-b0a0-475d-a2f4-a32cd026a911');
-		const chTime     = await service.getCharacteristic('00000003-b0a0-475d-a2f4-a32cd026a911');
 		this._chTimeZone = await service.getCharacteristic('00000004-b0a0-475d-a2f4-a32cd026a911');
 		this._chBright   = await service.getCharacteristic('00000005-b0a0-475d-a2f4-a32cd026a911');
-		const chTimeAcc  = await service.getCharacteristic('00000006-b0a0-475d-a2f4-a32cd026a911');
+		const chStatus   = await service.getCharacteristic('00000009-b0a0-475d-a2f4-a32cd026a911');
+		this._chSync     = await service.getCharacteristic('0000000a-b0a0-475d-a2f4-a32cd026a911');
+		const chTelemetry = await service.getCharacteristic('0000000b-b0a0-475d-a2f4-a32cd026a911');
+		this._chTzRule   = await service.getCharacteristic('0000000c-b0a0-475d-a2f4-a32cd026a911');
+		this._chLeapSmear = await service.getCharacteristic('0000000d-b0a0-475d-a2f4-a32cd026a911');
 
 		this._log('Retrieving values...');
-		const time       = new TextDecoder().decode(await chTime.readValue());
-		this._onGotValue('Time', time);
-		const timeZone   = (await this._chTimeZone.readValue()).getInt32(0, true);
-		this._onGotValue('TimeZone', timeZone);
+		this._timeZone   = (await this._chTimeZone.readValue()).getInt32(0, true);
+		this._onGotValue('TimeZone', this._timeZone);
+		this._onGotValue('TimeZoneRule', new TextDecoder().decode(await this._chTzRule.readValue()));
 		const brightness = (await this._chBright  .readValue()).getInt8(0);
 		this._onGotValue('Brightness', brightness);
+		this._onGotValue('LeapSmear', (await this._chLeapSmear.readValue()).getUint8(0) !== 0);
+		this._gotStatus(await chStatus.readValue());
 
 		this._log('Starting notifications...');
-		await chTime.startNotifications();
-		chTime.addEventListener('characteristicvaluechanged', this._boundHandleChNotifyTime)
-		await chTimeAcc.startNotifications();
-		chTimeAcc.addEventListener('characteristicvaluechanged', this._boundHandleChNotifyTimeAcc)
+		await chStatus.startNotifications();
+		chStatus.addEventListener('characteristicvaluechanged', this._boundHandleChNotifyStatus)
+		await this._chSync.startNotifications();
+		this._chSync.addEventListener('characteristicvaluechanged', this._boundHandleChNotifySync)
+		chTelemetry.addEventListener('characteristicvaluechanged', this._boundHandleChNotifyTelemetry)
+		await chTelemetry.startNotifications();
 
 		this._log('Connected');
 	}
@@ -104,18 +174,67 @@ class ClockConfig {
 
 		this._log('Setting ' + name + ' to ' + value);
 		if (name === 'TimeZone') {
+			this._timeZone = value;
 			const buf = new ArrayBuffer(4);
 			new DataView(buf).setUint32(0, value, true);
 			await this._chTimeZone.writeValueWithoutResponse(buf);
+			this._onGotValue('TimeZoneRule', '');
+		} else if (name === 'TimeZoneRule') {
+			// A zone name comes back as its rule.  Ones the clock can't follow are refused.
+			await this._chTzRule.writeValueWithResponse(new TextEncoder().encode(value));
+			this._onGotValue('TimeZoneRule', new TextDecoder().decode(await this._chTzRule.readValue()));
 		} else if (name === 'Brightness') {
 			const buf = new ArrayBuffer(1);
 			new DataView(buf).setInt8(0, value);
 			await this._chBright.writeValueWithoutResponse(buf);
+		} else if (name === 'LeapSmear') {
+			await this._chLeapSmear.writeValueWithoutResponse(new Uint8Array([value ? 1 : 0]));
 		} else {
 			this._log('Unknown value!');
 		}
 	}
 
+	// Measure this computer's clock against the clock, NTP style.  Of a few
+	// round trips the one with the least delay is kept, since it had the
+	// least room for asymmetry.  Reports the offset (this computer minus the
+	// clock) and its error bound, half the round trip delay, in us.
+	async syncTime(rounds = 8) {
+		if (!this._device || !this._device.gatt.connected) {
+			return;
+		}
+
+		this._log('Syncing time');
+		let best = null;
+		for (let sequence = 1; sequence <= rounds; sequence++) {
+			const reply = new Promise((resolve) => {
+				this._syncWaiting = {sequence: sequence, resolve: resolve};
+				setTimeout(() => resolve(null), 1000);
+			});
+			const buf  = new ArrayBuffer(12);
+			const view = new DataView(buf);
+			view.setUint32(0, sequence, true);
+			view.setBigInt64(4, this._nowUs(), true);
+			await this._chSync.writeValueWithoutResponse(buf);
+
+			const sample = await reply;
+			if (!sample || sample.receive === 0n) {
+				continue;
+			}
+			const delay  = (sample.clientRx - sample.clientTx) - (sample.transmit - sample.receive);
+			const offset = ((sample.clientTx - sample.receive) + (sample.clientRx - sample.transmit)) / 2n;
+			if (!best || delay < best.delay) {
+				best = {offset: offset, delay: delay, accuracy: sample.accuracy};
+			}
+		}
+		this._syncWaiting = null;
+
+		if (!best) {
+			this._log('Clock has no time to sync to');
+			return;
+		}
+		this._onGotValue('Offset', {offset: Number(best.offset), error: Number(best.delay) / 2});
+	}
+
 	async sendCommandSave() {
 		if (!this._device || !this._device.gatt.connected) {
 			return;
@@ -3,12 +3,21 @@ const config = new ClockConfig();
 const buttonConnect    = document.getElementById('connect');
 const buttonDisconnect = document.getElementById('disconnect');
 const buttonSave       = document.getElementById('save');
+const buttonSync       = document.getElementById('sync');
 const labelTime        = document.getElementById('time');
 const labelTimeAcc     = document.getElementById('time-accuracy');
+const labelTimeStatus  = document.getElementById('time-status');
+const labelOffset      = document.getElementById('offset');
+const labelLock        = document.getElementById('lock');
 const inputTimeZone    = document.getElementById('timezone');
+const inputTzRule      = document.getElementById('timezone-rule');
 const inputBrightness  = document.getElementById('brightness');
+const inputLeapSmear   = document.getElementById('leap-smear');
 const textAreaLog      = document.getElementById('log');
 
+// Telemetry records from the clock, oldest first, up to an hour's worth
+let telemetry = [];
+
 buttonDisconnect.disabled = true;
 
 if (!('bluetooth' in navigator)) {
@@ -34,10 +43,25 @@ config._onGotValue = function(name, value) {
 			value = value + 'ns';
 		}
 		labelTimeAcc.innerText = "±" + value;
+	} else if (name === 'Status') {
+		const fixes  = {0: 'no fix', 2: '2D fix', 3: '3D fix', 5: 'time only fix'};
+		const servos = ['no time', 'set', 'locked'];
+		labelTimeStatus.innerText = (servos[value.servo] ?? '?') + ', ' + (fixes[value.fix] ?? 'fix ' + value.fix);
+	} else if (name === 'Offset') {
+		labelOffset.innerText = (value.offset / 1000).toFixed(1) + 'ms ±' + (value.error / 1000).toFixed(1) + 'ms';
+	} else if (name === 'Telemetry') {
+		telemetry = telemetry.concat(value).slice(-3600);
+		const last = telemetry[telemetry.length - 1];
+		labelLock.innerText = 'error ' + last.errorNs + 'ns, drift ' + last.driftPpb + 'ppb, PPS latency ' +
+			last.ppsLatencyUs + 'us, ' + telemetry.length + 's of history';
 	} else if (name === 'TimeZone') {
 		inputTimeZone.value = value;
+	} else if (name === 'TimeZoneRule') {
+		inputTzRule.value = value;
 	} else if (name === 'Brightness') {
 		inputBrightness.value = value;
+	} else if (name === 'LeapSmear') {
+		inputLeapSmear.checked = value;
 	}
 };
 
@@ -45,11 +69,20 @@ config._onDisconnected = function() {
 	buttonConnect.disabled    = false;
 	buttonDisconnect.disabled = true;
 	buttonSave.disabled       = true;
+	buttonSync.disabled       = true;
+	labelOffset.innerText     = '';
+	labelLock.innerText       = '';
+	telemetry                 = [];
 	labelTime.innerText       = '';
 	labelTimeAcc.innerText    = '';
+	labelTimeStatus.innerText = '';
 	inputTimeZone.disabled    = true;
 	inputTimeZone.value       = '';
+	inputTzRule.disabled      = true;
+	inputTzRule.value         = '';
 	inputBrightness.disabled  = true;
+	inputLeapSmear.disabled   = true;
+	inputLeapSmear.checked    = false;
 };
 
 buttonConnect.onclick = function(event) {
@@ -58,8 +91,11 @@ buttonConnect.onclick = function(event) {
 		.then(() => {
 			buttonDisconnect.disabled = false;
 			buttonSave.disabled       = false;
+			buttonSync.disabled       = false;
 			inputTimeZone.disabled    = false;
+			inputTzRule.disabled      = false;
 			inputBrightness.disabled  = false;
+			inputLeapSmear.disabled   = false;
 		})
 		.catch((error) => {
 			config._log('Error: ' + error);
@@ -79,11 +115,28 @@ inputTimeZone.oninput = async function(event) {
 	}
 }
 
+// Applied when done editing, since most of the way through a rule isn't one
+inputTzRule.onchange = async function(event) {
+	await config.setValue('TimeZoneRule', inputTzRule.value.trim())
+		.catch((error) => config._log('Time zone rule not accepted: ' + error));
+}
+
 inputBrightness.oninput = async function(event) {
 	const brightness = Math.min(Math.max(inputBrightness.value, 0), 127);
 	await config.setValue('Brightness', brightness);
 }
 
+inputLeapSmear.onchange = async function(event) {
+	await config.setValue('LeapSmear', inputLeapSmear.checked);
+}
+
+buttonSync.onclick = function(event) {
+	buttonSync.disabled = true;
+	config.syncTime()
+		.catch((error) => config._log('Error: ' + error))
+		.finally(() => buttonSync.disabled = false);
+}
+
 buttonSave.onclick = function(event) {
 	config.sendCommandSave();
 }
\ No newline at end of file
@@ -0,0 +1,189 @@
+#include "flash_log.hpp"
+#include "flash_window.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+static uint32_t crc32(uint32_t crc, std::span<const uint8_t> data)
+{
+	crc = ~crc;
+	for (uint8_t byte : data)
+	{
+		crc ^= byte;
+		for (int bit = 0; bit < 8; bit++)
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+	}
+	return ~crc;
+}
+
+static bool is_erased(const uint8_t* data, uint32_t length)
+{
+	return std::all_of(data, data + length, [](uint8_t byte) { return byte == 0xff; });
+}
+
+// Flash can't be read while it's being written, so these run with
+// interrupts off and the other core (if it's running) parked, between
+// display frames.  One page or one sector at a time, the smallest steps
+// the flash does.
+struct Flash_Program
+{
+	uint32_t offset;
+	uint8_t  page[FLASH_PAGE_SIZE];
+};
+
+static void do_program(void* param)
+{
+	const Flash_Program* program = (const Flash_Program*)param;
+	flash_range_program(program->offset, program->page, FLASH_PAGE_SIZE);
+}
+
+static void do_erase(void* param)
+{
+	flash_range_erase(*(const uint32_t*)param, FLASH_SECTOR_SIZE);
+}
+
+const uint8_t* Flash_Log::slot_addr(uint32_t sector, uint32_t slot) const
+{
+	return (const uint8_t*)XIP_BASE + flash_offset + sector * FLASH_SECTOR_SIZE + slot * slot_size;
+}
+
+const Flash_Log::Header* Flash_Log::valid_record(const uint8_t* slot) const
+{
+	const Header* header = (const Header*)slot;
+	if (header->magic != magic || header->key >= max_keys || header->length > max_payload)
+		return nullptr;
+	uint32_t crc = crc32(0, std::span(slot, offsetof(Header, crc)));
+	crc = crc32(crc, std::span(slot + header_size, header->length));
+	return crc == header->crc ? header : nullptr;
+}
+
+void Flash_Log::init()
+{
+	latest = {};
+	stats  = {};
+	uint32_t newest_sequence = 0;
+	sector = 0;
+
+	for (uint32_t isector = 0; isector < num_sectors; isector++)
+	{
+		for (uint32_t islot = 0; islot < slots_per_sector; islot++)
+		{
+			const uint8_t* slot = slot_addr(isector, islot);
+			if (is_erased(slot, slot_size))
+				continue;
+			const Header* header = valid_record(slot);
+			if (!header)
+			{
+				stats.bad_slots++;
+				continue;
+			}
+
+			const Header*& newest = latest[header->key];
+			if (!newest || header->sequence > newest->sequence)
+				newest = header;
+			if (header->sequence > newest_sequence)
+			{
+				newest_sequence = header->sequence;
+				sector = isector;
+			}
+		}
+	}
+	next_sequence = newest_sequence + 1;
+
+	// Append after whatever was written last in the newest sector, good or not
+	next_slot = slots_per_sector;
+	while (next_slot > 0 && is_erased(slot_addr(sector, next_slot - 1), slot_size))
+		next_slot--;
+}
+
+bool Flash_Log::read(uint8_t key, uint8_t& version, std::span<const uint8_t>& payload) const
+{
+	if (key >= max_keys || !latest[key])
+		return false;
+	version = latest[key]->version;
+	payload = std::span((const uint8_t*)latest[key] + header_size, latest[key]->length);
+	return true;
+}
+
+bool Flash_Log::append(uint8_t key, uint8_t version, std::span<const uint8_t> payload)
+{
+	const uint8_t* slot = slot_addr(sector, next_slot);
+	uint32_t offset = slot - (const uint8_t*)XIP_BASE;
+
+	// Program the whole page.  Only the zero bits have any effect, so
+	// everything around the slot stays as it is.
+	Flash_Program program;
+	program.offset = offset & ~(FLASH_PAGE_SIZE - 1);
+	memset(program.page, 0xff, sizeof(program.page));
+	uint8_t* record = program.page + (offset - program.offset);
+
+	Header header   = {};
+	header.sequence = next_sequence;
+	header.magic    = magic;
+	header.key      = key;
+	header.version  = version;
+	header.length   = payload.size();
+	memcpy(record, &header, header_size);
+	memcpy(record + header_size, payload.data(), payload.size());
+	header.crc = crc32(crc32(0, std::span(record, offsetof(Header, crc))), payload);
+	memcpy(record, &header, header_size);
+
+	// The slot is used up whether or not this works
+	next_sequence++;
+	next_slot++;
+	flash_window_execute(do_program, &program);
+
+	// Check it, so a bad write can't hide the last good copy
+	const Header* written = valid_record(slot);
+	if (!written || written->sequence != header.sequence)
+	{
+		stats.bad_slots++;
+		return false;
+	}
+	latest[key] = written;
+	stats.writes++;
+	return true;
+}
+
+bool Flash_Log::next_sector()
+{
+	static_assert(reserved_slots > max_keys);
+	uint32_t next = (sector + 1) % num_sectors;
+
+	// The sector we're moving to is the oldest.  Anything whose newest copy
+	// is still there comes here, into the reserved slots, before it's erased.
+	for (uint8_t key = 0; key < max_keys; key++)
+	{
+		const uint8_t* record = (const uint8_t*)latest[key];
+		if (!record || record < slot_addr(next, 0) || record >= slot_addr(next, slots_per_sector))
+			continue;
+
+		// Copy it out first; flash isn't readable while it's written
+		uint8_t version = latest[key]->version;
+		uint8_t payload[max_payload];
+		uint8_t length  = latest[key]->length;
+		memcpy(payload, record + header_size, length);
+
+		if (next_slot >= slots_per_sector || !append(key, version, std::span(payload, length)))
+			return false;  // Don't erase the only copy
+		stats.carried++;
+	}
+
+	uint32_t offset = slot_addr(next, 0) - (const uint8_t*)XIP_BASE;
+	flash_window_execute(do_erase, &offset);
+	stats.erases++;
+	sector    = next;
+	next_slot = 0;
+	return true;
+}
+
+bool Flash_Log::write(uint8_t key, uint8_t version, std::span<const uint8_t> payload)
+{
+	static_assert(FLASH_SECTOR_SIZE % slot_size == 0 && FLASH_PAGE_SIZE % slot_size == 0);
+	if (key >= max_keys || payload.size() > max_payload || num_sectors < 2)
+		return false;
+
+	if (slots_per_sector - next_slot <= reserved_slots && !next_sector())
+		return false;
+	return append(key, version, payload);
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <span>
+#include "hardware/flash.h"
+
+// Log-structured key/value store across a few flash sectors.  Saving
+// appends a CRC-checked record after the last one, so the previous copy is
+// never touched; a power cut at any point leaves either the old value or
+// the new one.  When a sector fills, the log moves on to the oldest sector,
+// first copying forward anything in it that's still current.  Sectors are
+// used in turn, which spreads the wear.  The newest record of each key is
+// indexed in RAM by init(), so neither reads nor appends scan flash.
+struct Flash_Log
+{
+	static constexpr uint32_t slot_size        = 64;
+	static constexpr uint32_t header_size      = 16;
+	static constexpr uint32_t max_payload      = slot_size - header_size;
+	static constexpr uint32_t max_keys         = 4;
+	static constexpr uint32_t slots_per_sector = FLASH_SECTOR_SIZE / slot_size;
+	// Kept free at the end of each sector for carrying records forward
+	static constexpr uint32_t reserved_slots   = max_keys + 1;
+
+	struct Stats
+	{
+		uint32_t writes;
+		uint32_t erases;
+		uint32_t carried;    // Records copied forward out of a sector being erased
+		uint32_t bad_slots;  // Written but not valid, e.g. cut off by a power loss
+	};
+
+	// flash_offset is from the start of flash, and sector aligned
+	Flash_Log(uint32_t flash_offset, uint32_t num_sectors) :
+		flash_offset(flash_offset), num_sectors(num_sectors) {}
+
+	// Scan the sectors and build the index.  Call once, before anything else.
+	void init();
+	// Newest record of a key.  Returns false if there isn't one.
+	bool read(uint8_t key, uint8_t& version, std::span<const uint8_t>& payload) const;
+	// Append a record.  Returns false if it's too long, or didn't verify.
+	bool write(uint8_t key, uint8_t version, std::span<const uint8_t> payload);
+
+	Stats stats = {};
+
+private:
+	struct [[gnu::packed]] Header
+	{
+		uint32_t sequence;  // One more than the record before, across all sectors
+		uint16_t magic;
+		uint8_t  key;
+		uint8_t  version;   // Of the payload's layout; up to the caller
+		uint8_t  length;    // Of the payload
+		uint8_t  reserved[3];
+		uint32_t crc;       // CRC-32 of the header up to here, then the payload
+	};
+	static_assert(sizeof(Header) == header_size);
+	static constexpr uint16_t magic = 0x4C46;  // "FL"
+
+	const uint8_t* slot_addr(uint32_t sector, uint32_t slot) const;
+	const Header*  valid_record(const uint8_t* slot) const;
+	bool append(uint8_t key, uint8_t version, std::span<const uint8_t> payload);
+	bool next_sector();
+
+	uint32_t flash_offset;
+	uint32_t num_sectors;
+	std::array<const Header*, max_keys> latest = {};
+	uint32_t sector        = 0;  // Being appended to
+	uint32_t next_slot     = 0;  // In that sector
+	uint32_t next_sequence = 1;
+};
@@ -0,0 +1,67 @@
+#include "flash_window.hpp"
+#include <pico/flash.h>
+#include <pico/time.h>
+
+// Long enough that frames must have stopped
+static constexpr uint64_t wait_timeout_us = 10'000;
+
+static volatile uint32_t windows;  // Opened so far
+static volatile uint64_t window_due_us;
+static volatile uint32_t window_period_us;
+static uint32_t missed_frames;
+static volatile uint32_t operations;
+
+struct Window_Step
+{
+	void   (*func)(void*);
+	void*    param;
+	uint64_t due_us;
+	uint32_t period_us;
+	uint64_t end_us;
+};
+
+// Runs with interrupts off, so the frame alarm can't move the deadline
+// between reading it and starting
+static void run_step(void* param)
+{
+	Window_Step* step = (Window_Step*)param;
+	step->due_us    = window_due_us;
+	step->period_us = window_period_us;
+	step->func(step->param);
+	step->end_us    = time_us_64();
+	operations = operations + 1;
+}
+
+void flash_window_open(uint64_t next_due_us, uint32_t period_us)
+{
+	window_due_us    = next_due_us;
+	window_period_us = period_us;
+	windows = windows + 1;
+}
+
+int flash_window_execute(void (*func)(void*), void* param)
+{
+	uint32_t seen = windows;
+	uint64_t give_up_us = time_us_64() + wait_timeout_us;
+	while (windows == seen && time_us_64() < give_up_us)
+		sleep_us(10);
+	bool in_window = windows != seen;
+
+	Window_Step step = {func, param};
+	int result = flash_safe_execute(run_step, &step, UINT32_MAX);
+
+	// Each deadline passed is a frame that didn't go out on time
+	if (in_window && step.end_us > step.due_us && step.period_us > 0)
+		missed_frames += (step.end_us - step.due_us) / step.period_us + 1;
+	return result;
+}
+
+uint32_t flash_window_missed_frames()
+{
+	return missed_frames;
+}
+
+uint32_t flash_window_operations()
+{
+	return operations;
+}
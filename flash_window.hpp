@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+
+// Flash can't be read while it's programmed or erased, and the SDK keeps
+// interrupts off for the whole operation, so the display alarm can't run
+// through one.  Flash operations wait here for the gap after a frame is
+// latched and sent, which a page program fits in.  A sector erase (tens of
+// ms) doesn't fit any gap; the frames it costs are counted.
+
+// From the frame alarm, once the next frame is sent and its latch scheduled
+void flash_window_open(uint64_t next_due_us, uint32_t period_us);
+// Run func(param) at the start of the next window, with interrupts off and
+// the other core parked.  If frames aren't running, it runs after a short
+// wait.  Returns the flash_safe_execute status.
+int flash_window_execute(void (*func)(void*), void* param);
+// Frame deadlines that passed while flash was busy, since boot
+uint32_t flash_window_missed_frames();
+// Flash operations run since boot.  Counted before interrupts are back on,
+// so an interrupt held off by one already sees it.
+uint32_t flash_window_operations();
@@ -1,221 +1,646 @@
 #include "gps.hpp"
+#include "boot.hpp"
+#include "clock_servo.hpp"
+#include "flash_window.hpp"
+#include "log.hpp"
+#include "pps_capture.hpp"
+#include "seqlock.hpp"
+#include "timing.hpp"
+#include "ubx.hpp"
+#include "ubx_parser.hpp"
+#include "ubx_tx.hpp"
+#include "hardware/dma.h"
+#include "hardware/sync.h"
 #include "hardware/uart.h"
+#include <algorithm>
 #include <charconv>
 #include <chrono>
 #include <cstring>
+#include <span>
+
+static constexpr uint rx_ring_bits = 11;
 
 static uart_inst_t* uart;
-static std::array<uint8_t, 32> rx_buf;  // Needs to be at least as big as the largest message we expect
-static uint         rx_buf_pos         = rx_buf.size();  // Start in overrun state
-static uint64_t     clock_offset_us    = 0;
+// Filled by DMA straight from the UART.  Aligned so the DMA can wrap around it.
+alignas(1 << rx_ring_bits) static std::array<uint8_t, 1 << rx_ring_bits> rx_ring;
+static Ubx_Ring_Parser rx_parser(rx_ring);
+static int          rx_dma_channel;
+static uint32_t     rx_dma_restarted   = 0;  // Bytes received before the DMA count was last topped up
+static uint32_t     rx_overruns        = 0;  // Already logged
+static Ubx_Tx_Queue tx_queue;
+static Clock_Servo  servo;
 static uint64_t     last_pps_time_us   = 0;
+static uint32_t     last_pps_frac      = 0;      // Plus this many 2^-32 us
+static int32_t      last_pps_qerr_ps   = 0;      // Quantization error of the last edge
+// TIM-TP gives the quantization error of the coming edge, which takes it over
+static volatile int32_t next_pps_qerr_ps    = 0;
+static volatile bool    next_pps_qerr_valid = false;
+static bool         last_pps_trusted   = false;  // Not held up by a flash operation
+static uint32_t     pps_flash_ops      = 0;      // Flash operations as of the last edge
 static uint64_t     last_msg_time_us   = 0;
-static int          last_correction_us = 0;
-static uint32_t     time_accuracy         = 0xFFFFFFFF;
+static Seqlock<Clock_State> clock_state;
+static uint          link_baud          = 0;
+static Gps_Latency  latency            = {.min_us = UINT32_MAX};
+static uint8_t      fix_type           = 0;
+// GPS time minus UTC, from the last message with valid UTC, or saved from last time
+static int8_t       leap_s             = 0;
+static bool         leap_known         = false;
+// Saved UTC.  It's at least this late now, unless the receiver keeps
+// saying otherwise; the first fix that's believed clears it.
+static int64_t      warm_utc_us        = 0;
+static int64_t      early_utc_us       = 0;  // Last fix earlier than warm_utc_us
+static int          early_fixes        = 0;  // How many in a row, each a second or two on
+static constexpr int early_fixes_believed = 10;
+// The next leap second, from NAV-TIMELS.  Armed until the servo is back on UTC.
+static Leap_Event   leap_event;
+static bool         leap_smear         = false;
+static uint32_t     config_fingerprint = 0;  // Of the configuration the receiver has
 
-static std::pair<uint8_t, uint8_t> ubx_checksum(std::span<uint8_t> data)
+// Make the servo's latest timebase visible to the display, all in one piece
+static void publish_clock_state(uint32_t accuracy_ns, uint64_t pps_time_us)
 {
-	uint8_t ck_a = 0, ck_b = 0;
-	for (uint8_t b : data)
-	{
-		ck_a += b;
-		ck_b += ck_a;
-	}
-	return {ck_a, ck_b};
+	clock_state.write({
+		.valid       = servo.valid(),
+		.locked      = servo.locked(),
+		.model       = servo.model(),
+		.accuracy_ns = accuracy_ns,
+		.last_pps_us = pps_time_us,
+		.error_ns       = servo.last_error_ns(),
+		.drift_ppb      = servo.drift_ppb(),
+		.pps_latency_us = latency.last_us,
+		.leap           = leap_event,
+	});
 }
 
-template <typename T>
-T read_bytes(std::span<uint8_t>& data)
+// GPS time minus UTC, from a message's time of week and the UTC it gives
+static int32_t implied_leap_s(const Ubx_Nav_TimeUTC& msg, Time_us utc_time)
 {
-	T value;
-	std::memcpy(&value, data.data(), sizeof(T));
-	data = data.subspan(sizeof(T));
-	return value;
+	using namespace std::chrono;
+	constexpr int32_t week_s = 7 * 86400;
+	int32_t utc_tow_s = duration_cast<seconds>(utc_time - Time_us(sys_days{year{1980} / 1 / 6})).count() % week_s;
+	int32_t gps_tow_s = (msg.iTOW + 500) / 1000;
+	int32_t leap = (gps_tow_s - utc_tow_s + week_s) % week_s;
+	return leap > week_s / 2 ? leap - week_s : leap;
 }
 
-template <typename T>
-void skip_bytes(std::span<uint8_t>& data)
+static void on_nav_timeutc(const Ubx_Nav_TimeUTC& msg)
 {
-	data = data.subspan(sizeof(T));
-}
+	uint64_t hw_time_us = to_us_since_boot(get_absolute_time());
 
+	// Written by the PPS interrupt, so don't let it in halfway through reading
+	uint32_t ints = save_and_disable_interrupts();
+	uint64_t pps_time_us = last_pps_time_us;
+	uint32_t pps_frac    = last_pps_frac;
+	int32_t  qerr_ps     = last_pps_qerr_ps;
+	bool     pps_trusted = last_pps_trusted;
+	restore_interrupts(ints);
 
-static void handle_ubx(std::span<uint8_t> msg)
-{
-	if (msg.size() < 6)  // Shortest possible message with zero payload
-		return;
-	
-	// First validate the checksum
-	auto [ck_a, ck_b] = ubx_checksum(msg.subspan(0, msg.size()-2));
-	if (ck_a != msg[msg.size()-2] || ck_b != msg[msg.size()-1])
+	// Assemble the time
+	using namespace std::chrono;
+	Time_us utc_time  = sys_days{year{msg.year} / month{msg.month} / day{msg.day}} + 
+	                    hours{msg.hour} + minutes{msg.min} + seconds{msg.sec};
+	uint32_t accuracy_ns = msg.tAcc;
+
+	bool utc_valid = msg.valid & 0x04;
+	bool gps_valid = (msg.valid & 0x03) == 0x03;  // Time of week and week number
+	int32_t leap = implied_leap_s(msg, utc_time);
+	if (utc_valid)
+	{
+		leap_s     = leap;
+		leap_known = true;
+	}
+	else if (gps_valid && leap_known)
+	{	// From a cold start the receiver knows GPS time well before it hears
+		// the leap second count, which can take 12.5 minutes.  Use the count
+		// from last time.  One may have been added since, so own up to a second.
+		utc_time   += seconds(leap - leap_s);
+		accuracy_ns = std::min<uint64_t>(uint64_t(msg.tAcc) + 1'000'000'000, UINT32_MAX);
+	}
+
+	// Past a leap second the servo carries on as if there hadn't been one, so
+	// the edges stay a second apart.  23:59:60 already comes out as midnight.
+	if (leap_event.armed() && utc_time >= leap_event.at && msg.sec != 60)
+		utc_time += seconds(leap_event.change);
+
+	bool believed = utc_valid || (gps_valid && leap_known);
+	int64_t utc_us = utc_time.time_since_epoch().count();
+	if (believed && utc_us < warm_utc_us)
+	{	// Earlier than the time saved last run.  A receiver that's just
+		// started can say anything, but if it keeps counting on from there,
+		// it's the saved time that was wrong.
+		int64_t since_us = utc_us - early_utc_us;
+		early_fixes  = since_us > 0 && since_us <= 2'000'000 ? early_fixes + 1 : 1;
+		early_utc_us = utc_us;
+		believed     = early_fixes >= early_fixes_believed;
+	}
+	if (!believed)
+	{	// Invalid UTC time, or earlier than we've already seen
+		servo.reset();
+		publish_clock_state(msg.tAcc, pps_time_us);
 		return;
-	
-	// We'll consume the message as we go
-	msg = msg.subspan(0, msg.size()-2);
+	}
+	warm_utc_us       = 0;  // Only a check on the first fix
+	early_fixes       = 0;
+	last_msg_time_us  = hw_time_us;
 
-	uint64_t hw_time_us = to_us_since_boot(get_absolute_time());
+	// Check how long it's been since the last PPS pulse
+	if (hw_time_us - pps_time_us < 1'000'000)
+	{	// Less than a second since last PPS.  We're going to ignore the
+		// milliseconds in the message, and let the servo align to the PPS.
+		// An edge that may have been timestamped late is left out; the
+		// timebase carries on from the edges before it.
+		if (pps_trusted)
+		{
+			servo.on_pps(pps_time_us, utc_time.time_since_epoch().count(), pps_frac, qerr_ps);
 
-	uint8_t cls = read_bytes<uint8_t>(msg);
-	uint8_t id  = read_bytes<uint8_t>(msg);
-	skip_bytes<uint16_t>(msg);  // Length
+			// How long after the edge we had the time to go with it
+			uint32_t latency_us = hw_time_us - pps_time_us;
+			latency.count++;
+			latency.last_us   = latency_us;
+			latency.min_us    = std::min(latency.min_us, latency_us);
+			latency.max_us    = std::max(latency.max_us, latency_us);
+			latency.total_us += latency_us;
+		}
+	}
+	else
+	{	// More than a second since last PPS.  We'll use the message time.
+		utc_time += microseconds(msg.nano / 1000);
+		servo.step(hw_time_us, utc_time.time_since_epoch().count());
+	}
 
-	// Now handle messages we're interested in.
-	if (cls == 0x01 && id == 0x21 && msg.size() == 20)  // UBX-NAV-TIMEUTC
+	// Once UTC is a whole second off again, move the servo onto it.  The
+	// display takes the new model and the end of the event together.
+	if (leap_event.armed() && utc_time >= leap_event.end())
 	{
-		skip_bytes<uint32_t>(msg);  // iTOW
-		time_accuracy  = read_bytes<uint32_t>(msg);
-		int32_t  nano  = read_bytes<int32_t>(msg);
-		uint16_t dy    = read_bytes<uint16_t>(msg);
-		uint8_t  dm    = read_bytes<uint8_t>(msg);
-		uint8_t  dd    = read_bytes<uint8_t>(msg);
-		uint8_t  th    = read_bytes<uint8_t>(msg);
-		uint8_t  tm    = read_bytes<uint8_t>(msg);
-		uint8_t  ts    = read_bytes<uint8_t>(msg);
-		uint8_t  valid = read_bytes<uint8_t>(msg);
-
-		if (!(valid & 0x04))
-		{	// Invalid UTC time
-			clock_offset_us = 0;
-			return;
-		}
+		servo.shift(-duration_cast<microseconds>(seconds(leap_event.change)).count());
+		leap_event = {};
+	}
 
-		// Assemble the time
-		using namespace std::chrono;
-		Time_us utc_time  = sys_days{year{dy} / month{dm} / day{dd}} + hours{th} + minutes{tm} + seconds{ts};
-		uint64_t old_offset = clock_offset_us;
-		last_msg_time_us    = hw_time_us;
-
-		// Check how long it's been since the last PPS pulse
-		if (hw_time_us - last_pps_time_us < 1'000'000)
-		{	// Less than a second since last PPS.  We're going to ignore the
-			// milliseconds in the message, and align the second to the PPS.
-			clock_offset_us = utc_time.time_since_epoch().count() - last_pps_time_us;
-		}
-		else
-		{	// More than a second since last PPS.  We'll use the message time.
-			utc_time += microseconds(nano / 1000);
-			clock_offset_us = utc_time.time_since_epoch().count() - hw_time_us;
-		}
+	publish_clock_state(accuracy_ns, pps_time_us);
+
+	boot_mark(Boot_Phase::TIME_VALID);
+	log_write(Log_Id::GPS_FIX, servo.last_error_ns(), servo.drift_ppb(), latency.last_us);
+}
+
+// Arm the next leap second, or call it off, while it's still ahead of us.
+// Only the moment it's due is worked out here; the display just compares.
+static void on_nav_timels(const Ubx_Nav_TimeLS& msg)
+{
+	using namespace std::chrono;
+	Clock_State clock = clock_state.read();
+	if (!clock.valid || !(msg.valid & 0x02))
+		return;
+	uint64_t hw_time_us = time_us_64();
+	Time_us now{microseconds(hw_time_us + clock.offset_us(hw_time_us))};
+	if (now >= leap_event.start)
+		return;  // Under way; let it finish
 
-		last_correction_us = clock_offset_us - old_offset;
-		printf("%+d\n", last_correction_us);
+	Leap_Event event;
+	if (msg.lsChange != 0 && msg.timeToLsEvent > 0)
+	{	// Always at a UTC midnight, so round off the seconds the message took
+		Time_us at = floor<days>(now + seconds(msg.timeToLsEvent) + hours(12));
+		event = Leap_Event::make(at, msg.lsChange, leap_smear);
+		// Too late to start smearing without a jump, so fall back to 23:59:60
+		if (event.smear && now >= event.start)
+			event = Leap_Event::make(at, msg.lsChange, false);
 	}
+	if (event.at == leap_event.at && event.change == leap_event.change && event.smear == leap_event.smear)
+		return;
+
+	leap_event = event;
+	clock.leap = event;
+	clock_state.write(clock);
+	log_write(Log_Id::GPS_LEAP_SECOND, event.change,
+		uint32_t(event.armed() ? floor<days>(event.at).time_since_epoch().count() - 1 : 0), event.smear);
 }
 
-static void uart_rx_isr()
+static void on_nav_status(const Ubx_Nav_Status& msg)
 {
-	while (uart_is_readable(uart))
-	{
-		char ch = uart_getc(uart);
-		
-		// We only care about UBX messages. They start with 0xB5, 0x62.
-		// Use rx_buf_pos as a sort of state machine, invalidating when the frame looks bad.
-		if (rx_buf_pos == 0 && ch != 0xB5)
-				continue;
-		if (rx_buf_pos == 1 && ch != 0x62)
-		{
-			rx_buf_pos = 0;
-			continue;
-		}
-		if (rx_buf_pos >= rx_buf.size())
-		{	// We've overrun the buffer.  Start over.
-			rx_buf_pos = 0;
-			continue;
-		}
+	fix_type = msg.gpsFix;
+}
 
-		rx_buf[rx_buf_pos++] = ch;
-		if (rx_buf_pos > 6)
-		{	// We have enough to check the length
-			uint16_t len = rx_buf[4] | (rx_buf[5] << 8);
-			if (rx_buf_pos == len + 8)
-			{	// We have a complete message
-				handle_ubx(std::span(rx_buf.data()+2, len+6));
-				rx_buf_pos = 0;
-			}
-		}
+static void on_tim_tp(const Ubx_Tim_TP& msg)
+{
+	next_pps_qerr_ps    = msg.qErr;
+	next_pps_qerr_valid = true;
+}
+
+static void on_ack_nak(const Ubx_Ack_Nak& msg)
+{
+	uint32_t ints = save_and_disable_interrupts();
+	tx_queue.on_answer(msg.clsID, msg.msgID, false);
+	restore_interrupts(ints);
+	log_write(Log_Id::GPS_REJECTED, msg.clsID, msg.msgID);
+}
+
+static void on_ack_ack(const Ubx_Ack_Ack& msg)
+{
+	uint32_t ints = save_and_disable_interrupts();
+	tx_queue.on_answer(msg.clsID, msg.msgID, true);
+	restore_interrupts(ints);
+}
+
+static constexpr std::array ubx_handlers = {
+	ubx_dispatch_entry<Ubx_Nav_Status,  on_nav_status>(),
+	ubx_dispatch_entry<Ubx_Nav_TimeUTC, on_nav_timeutc>(),
+	ubx_dispatch_entry<Ubx_Nav_TimeLS,  on_nav_timels>(),
+	ubx_dispatch_entry<Ubx_Ack_Nak,     on_ack_nak>(),
+	ubx_dispatch_entry<Ubx_Ack_Ack,     on_ack_ack>(),
+	ubx_dispatch_entry<Ubx_Tim_TP,      on_tim_tp>(),
+};
+
+static void handle_ubx(std::span<uint8_t> msg)
+{
+	uint32_t start = timing_cycles();
+	// The parser has already checked the framing and checksum
+	ubx_dispatch(ubx_handlers, msg);
+	timing_end(Timing::UBX_HANDLER, start);
+}
+
+// Feed the UART FIFO from the queue until one or the other runs out.  Called
+// from the TX interrupt, or with interrupts off to get it started.
+static void tx_fill()
+{
+	uint64_t now_us = time_us_64();
+	while (uart_is_writable(uart))
+	{
+		int byte = tx_queue.next_byte(now_us);
+		if (byte < 0)
+			break;
+		uart_putc_raw(uart, byte);
 	}
+	// The interrupt fires as the FIFO drains, so only while there's more to send
+	uart_set_irq_enables(uart, false, !tx_queue.idle());
+}
+
+static void uart_tx_isr()
+{
+	uint32_t start = timing_cycles();
+	tx_fill();
+	timing_end(Timing::UART_TX_ISR, start);
 }
 
-void gps_send_ubx(uint8_t cls, uint8_t id, std::initializer_list<uint8_t> payload)
+// Queue a message for sending.  CFG messages are tracked until the receiver
+// answers them, unless want_ack is false.
+static bool gps_send_ubx(uint8_t cls, uint8_t id, std::span<const uint8_t> payload, bool want_ack = true)
 {
-	std::vector<uint8_t> buf;
-	buf.reserve(8 + payload.size());
-	buf.push_back(0xB5);
-	buf.push_back(0x62);
-	buf.push_back(cls);
-	buf.push_back(id);
-	uint16_t len = payload.size();
-	buf.push_back(len & 0xFF);
-	buf.push_back(len >> 8);
-	std::copy(payload.begin(), payload.end(), std::back_inserter(buf));
+	uint32_t ints = save_and_disable_interrupts();
+	bool queued = tx_queue.push(cls, id, payload, want_ack && cls == 0x06);
+	tx_fill();
+	restore_interrupts(ints);
+	return queued;
+}
 
-	auto [ck_a, ck_b] = ubx_checksum(std::span(buf.begin()+2, buf.end()));
-	buf.push_back(ck_a);
-	buf.push_back(ck_b);
+static bool gps_send_ubx(uint8_t cls, uint8_t id, std::initializer_list<uint8_t> payload, bool want_ack = true)
+{
+	return gps_send_ubx(cls, id, std::span(payload.begin(), payload.size()), want_ack);
+}
+
+// Wait a millisecond on the receiver.  gps_init_comms() can spend seconds
+// in these before the main loop starts, so the log is drained meanwhile, or
+// records from interrupts and the other core fill its queues and are lost.
+static void wait_ms()
+{
+	sleep_ms(1);
+	log_drain();
+}
 
-	uart_write_blocking(uart, buf.data(), buf.size());
+// Wait for everything queued to be sent, e.g. before changing baud rate
+static void tx_flush()
+{
+	while (!tx_queue.idle())
+		wait_ms();
+	uart_tx_wait_blocking(uart);
 }
 
 void gps_init_io(uart_inst_t* uart, uint baud, uint rx_pin, uint tx_pin)
 {
 	// Set up the GPS UART
 	::uart = uart;
-	uart_init(uart, baud);
+	link_baud = uart_init(uart, baud);
 	gpio_set_function(rx_pin, GPIO_FUNC_UART);
 	gpio_set_function(tx_pin, GPIO_FUNC_UART);
 	uart_set_hw_flow(uart, false, false);  // No CTS, no RTS
 	uart_set_format(uart, 8, 1, UART_PARITY_NONE);
-	
+
+	// Transmit from a queue, topped up by interrupt as the FIFO drains
 	uint gps_uart_irq = UART_IRQ_NUM(uart);
-	irq_set_exclusive_handler(gps_uart_irq, uart_rx_isr);
+	irq_set_exclusive_handler(gps_uart_irq, uart_tx_isr);
 	irq_set_enabled(gps_uart_irq, true);
-	uart_set_irq_enables(uart, true, false);
-}
-
-void gps_init_comms()
-{
-	gps_send_ubx(0x06, 0x01, {0xF0, 0x00, 0x00});  // UBX-CFG-MSG: GGA off
-	gps_send_ubx(0x06, 0x01, {0xF0, 0x01, 0x00});  // UBX-CFG-MSG: GLL off
-	gps_send_ubx(0x06, 0x01, {0xF0, 0x02, 0x00});  // UBX-CFG-MSG: GSA off
-	gps_send_ubx(0x06, 0x01, {0xF0, 0x03, 0x00});  // UBX-CFG-MSG: GSV off
-	gps_send_ubx(0x06, 0x01, {0xF0, 0x04, 0x00});  // UBX-CFG-MSG: RMC off
-	gps_send_ubx(0x06, 0x01, {0xF0, 0x05, 0x00});  // UBX-CFG-MSG: VTG off
-	gps_send_ubx(0x06, 0x01, {0x01, 0x21, 0x01});  // UBX-CFG-MSG: UBX-NAV-TIMEUTC 1Hz
-	gps_send_ubx(0x06, 0x31, {                     // UBX-CFG-TP5:
-			0x00,        // TIMEPULSE                 0
-			0x01,        // Message version           1 
-			0x00, 0x00,  // Reserved
-			0x00, 0x00,  // Antenna cable delay       0 ns
-			0x00, 0x00,  // RF group delay            0 ns
-			 1, 0, 0, 0, // Frequency                 1 Hz
-			 1, 0, 0, 0, // Locked frequency          1 Hz
-			10, 0, 0, 0, // Pulse length             10 us
-			10, 0, 0, 0, // Locked pulse length      10 us
-			 0, 0, 0, 0, // User configurable delay   0 ns
-			             // Flags:  (Bits 0-7)
-			 1<<0 |      //   Active
-			 1<<1 |      //   Locked to GPS time
-			 1<<3 |      //   Frequency units Hz
-			 1<<4 |      //   Time units us
-			 1<<5 |      //   Align to top of second
-			 1<<6,       //   Rising edge
-			             // Flags:  (Bits 8-15)
-			 1<<3,       //   Can lose sync
-			 0, 0,       // Flags;  (Bits 16-31 unused)
+
+	// Receive by DMA into the ring, so there's no interrupt per byte
+	rx_dma_channel = dma_claim_unused_channel(true);
+	dma_channel_config dma_config = dma_channel_get_default_config(rx_dma_channel);
+	channel_config_set_dreq(&dma_config, uart_get_dreq(uart, false));  // Paced by UART RX
+	channel_config_set_transfer_data_size(&dma_config, DMA_SIZE_8);
+	channel_config_set_read_increment(&dma_config, false);  // Always the data register
+	channel_config_set_write_increment(&dma_config, true);
+	channel_config_set_ring(&dma_config, true, rx_ring_bits);  // Wrap the write address
+	dma_channel_configure(rx_dma_channel, &dma_config,
+		rx_ring.data(),           // Write address: the ring
+		&uart_get_hw(uart)->dr,   // Read address: UART data register
+		0xFFFFFFFF,               // Transfer count: as good as forever, topped up in gps_poll
+		true                      // Start now
+	);
+}
+
+// Bytes the DMA has put in the ring since it started, running on past the
+// ring size, so the parser can tell if it's been lapped.  Read again as the
+// parser goes, since the DMA doesn't stop for it.
+static uint32_t rx_received()
+{
+	return rx_dma_restarted + (0xFFFFFFFF - dma_channel_hw_addr(rx_dma_channel)->transfer_count);
+}
+
+void gps_poll()
+{
+	rx_parser.parse(rx_received, handle_ubx);
+	if (rx_parser.overruns != rx_overruns)
+	{
+		log_write(Log_Id::GPS_RX_OVERRUN, rx_parser.overruns - rx_overruns);
+		rx_overruns = rx_parser.overruns;
+	}
+
+	uint32_t ints = save_and_disable_interrupts();
+	uint32_t failed = tx_queue.check_timeouts(time_us_64());
+	tx_fill();
+	restore_interrupts(ints);
+	if (failed)
+		log_write(Log_Id::GPS_NO_ANSWER, failed);
+
+	// The count would run out after a few days at high baud rates.  Restarting
+	// carries on from the current write address, and the UART FIFO covers the gap.
+	if (dma_channel_hw_addr(rx_dma_channel)->transfer_count < 0x80000000)
+	{
+		dma_channel_abort(rx_dma_channel);
+		rx_dma_restarted = rx_received();
+		dma_channel_set_trans_count(rx_dma_channel, 0xFFFFFFFF, true);
+	}
+}
+
+// Point the receiver's UART1 at a baud rate, UBX in and out, NMEA in only
+static void send_cfg_prt(uint baud)
+{
+	gps_send_ubx(0x06, 0x00, {    // UBX-CFG-PRT:
+		0x01,                     // Port                 UART1
+		0x00,                     // Reserved
+		0x00, 0x00,               // TX ready pin         off
+		0xD0, 0x08, 0x00, 0x00,   // Mode                 8N1
+		uint8_t(baud), uint8_t(baud >> 8), uint8_t(baud >> 16), uint8_t(baud >> 24),
+		0x03, 0x00,               // Input protocols      UBX, NMEA
+		0x01, 0x00,               // Output protocols     UBX
+		0x00, 0x00,               // Flags
+		0x00, 0x00,               // Reserved
+	}, false);  // The answer comes at either baud rate, or neither
+}
+
+// Wait until a valid UBX frame arrives, or give up
+static bool wait_for_ubx(uint32_t timeout_ms)
+{
+	gps_poll();  // Don't count what's already in the ring
+	uint32_t frames = rx_parser.frames;
+	for (uint32_t ms = 0; ms < timeout_ms; ms++)
+	{
+		wait_ms();
+		gps_poll();
+		if (rx_parser.frames != frames)
+			return true;
+	}
+	return false;
+}
+
+// Is the receiver talking to us at our current baud rate?  Polls the port
+// configuration, which gets an answer even if periodic messages are off.
+static bool probe_baud()
+{
+	gps_send_ubx(0x06, 0x00, {0x01}, false);  // Poll UBX-CFG-PRT for UART1
+	return wait_for_ubx(250);
+}
+
+static void set_baud(uint baud)
+{
+	tx_flush();
+	link_baud = uart_set_baudrate(uart, baud);
+}
+
+// Find the receiver's baud rate by trying the likely ones, starting with
+// the one we're at unless that's already been tried
+static bool find_baud(bool current_tried = false)
+{
+	static constexpr uint bauds[] = {9600, 115200, 38400, 230400, 57600, 19200, 460800, 4800};
+
+	uint current = link_baud;
+	if (!current_tried && probe_baud())
+		return true;
+	for (uint baud : bauds)
+	{
+		if (baud == current)
+			continue;
+		set_baud(baud);
+		if (probe_baud())
+			return true;
+	}
+	return false;
+}
+
+void gps_set_message_rate(uint8_t cls, uint8_t id, uint8_t rate)
+{
+	gps_send_ubx(0x06, 0x01, {cls, id, rate});  // UBX-CFG-MSG
+}
+
+void gps_set_leap_smear(bool smear)
+{
+	leap_smear = smear;
+}
+
+void gps_set_nav_rate(uint16_t period_ms)
+{
+	gps_send_ubx(0x06, 0x08, {    // UBX-CFG-RATE:
+		uint8_t(period_ms), uint8_t(period_ms >> 8),  // Measurement period
+		0x01, 0x00,               // Navigation solution every measurement
+		0x00, 0x00,               // Aligned to UTC
 	});
 }
 
-uint64_t gps_get_clock_offset_us()
+static constexpr uint16_t nav_period_ms = 1000;
+
+static constexpr uint8_t tp5_config[] = {    // UBX-CFG-TP5:
+	0x00,        // TIMEPULSE                 0
+	0x01,        // Message version           1 
+	0x00, 0x00,  // Reserved
+	0x00, 0x00,  // Antenna cable delay       0 ns
+	0x00, 0x00,  // RF group delay            0 ns
+	 1, 0, 0, 0, // Frequency                 1 Hz
+	 1, 0, 0, 0, // Locked frequency          1 Hz
+	10, 0, 0, 0, // Pulse length             10 us
+	10, 0, 0, 0, // Locked pulse length      10 us
+	 0, 0, 0, 0, // User configurable delay   0 ns
+	             // Flags:  (Bits 0-7)
+	 1<<0 |      //   Active
+	 1<<1 |      //   Locked to GPS time
+	 1<<3 |      //   Frequency units Hz
+	 1<<4 |      //   Time units us
+	 1<<5 |      //   Align to top of second
+	 1<<6,       //   Rising edge
+	             // Flags:  (Bits 8-15)
+	 1<<3,       //   Can lose sync
+	 0, 0,       // Flags;  (Bits 16-31 unused)
+};
+
+// FNV-1a over everything gps_init_comms sends, so a change to any of it
+// doesn't match what the receiver was left with
+static uint32_t fingerprint(uint baud, std::span<const Gps_Message_Rate> rates)
+{
+	uint32_t hash = 2166136261;
+	auto add = [&](const void* data, size_t size) {
+		for (size_t i = 0; i < size; i++)
+			hash = (hash ^ ((const uint8_t*)data)[i]) * 16777619;
+	};
+	add(&baud, sizeof(baud));
+	add(&nav_period_ms, sizeof(nav_period_ms));
+	add(rates.data(), rates.size_bytes());
+	add(tp5_config, sizeof(tp5_config));
+	return hash ? hash : 1;  // 0 means unknown
+}
+
+void gps_warm_start(const Warm_State& state)
+{
+	servo.set_drift_ppb(state.drift_ppb);
+	leap_s             = state.leap_s;
+	leap_known         = true;
+	warm_utc_us        = state.utc_us;
+	early_fixes        = 0;
+	config_fingerprint = state.fingerprint;
+	// Where the receiver is, if it's kept its configuration
+	if (state.baud != 0 && state.fingerprint != 0)
+		set_baud(state.baud);
+}
+
+bool gps_init_comms(uint baud, std::span<const Gps_Message_Rate> rates)
+{
+	uint32_t wanted_fingerprint = fingerprint(baud, rates);
+
+	// A receiver that's answering at the rate we last moved it to hasn't been
+	// powered down since, so it still has that configuration, and the time
+	bool current_tried = false;
+	if (config_fingerprint == wanted_fingerprint && link_baud == baud)
+	{
+		if (probe_baud())
+		{
+			log_write(Log_Id::GPS_CONFIGURED, link_baud);
+			return true;
+		}
+		current_tried = true;
+	}
+	config_fingerprint = 0;
+
+	// The receiver may have been left at any speed, e.g. if we reset without it
+	if (!find_baud(current_tried))
+	{
+		log_write(Log_Id::GPS_NOT_RESPONDING);
+		return false;
+	}
+
+	// Faster link, so messages arrive sooner after the second they describe
+	if (link_baud != baud)
+	{
+		send_cfg_prt(baud);
+		set_baud(baud);
+		// Periodic messages may be off, so ask.  It can take a moment to
+		// switch, and find_baud() tries the new rate again first.
+		if (!probe_baud() && !find_baud())
+		{
+			log_write(Log_Id::GPS_LOST);
+			return false;
+		}
+	}
+	log_write(Log_Id::GPS_BAUD, link_baud);
+
+	gps_set_nav_rate(nav_period_ms);
+	for (const Gps_Message_Rate& rate : rates)
+		gps_set_message_rate(rate.cls, rate.id, rate.rate);
+	gps_send_ubx(0x06, 0x31, tp5_config);
+	config_fingerprint = wanted_fingerprint;
+	return true;
+}
+
+bool gps_get_warm_state(Warm_State& state)
+{
+	if (!servo.locked() || !leap_known)
+		return false;
+	// Only vouch for the configuration if the receiver took all of it
+	Ubx_Tx_Queue::Stats stats = gps_get_tx_stats();
+	uint64_t hw_time_us = time_us_64();
+	state.utc_us      = hw_time_us + servo.offset_us(hw_time_us);
+	if (state.utc_us >= leap_event.start.time_since_epoch().count())
+	{	// Still on the servo's side of a leap second
+		bool second_60;
+		state.utc_us = leap_event.to_utc(Time_us(std::chrono::microseconds(state.utc_us)), second_60).time_since_epoch().count();
+	}
+	state.drift_ppb   = servo.drift_ppb();
+	state.fingerprint = stats.naked || stats.failed ? 0 : config_fingerprint;
+	state.baud        = link_baud;
+	state.leap_s      = leap_s;
+	return true;
+}
+
+Clock_State gps_get_clock_state()
 {
-	return clock_offset_us;
+	return clock_state.read();
+}
+
+uint64_t gps_get_clock_offset_us(uint64_t hw_time_us)
+{
+	return clock_state.read().offset_us(hw_time_us);
+}
+
+int32_t gps_get_drift_ppb()
+{
+	return servo.drift_ppb();
+}
+
+Gps_Latency gps_get_latency()
+{
+	return latency;
+}
+
+Ubx_Tx_Queue::Stats gps_get_tx_stats()
+{
+	uint32_t ints = save_and_disable_interrupts();
+	Ubx_Tx_Queue::Stats stats = tx_queue.stats;
+	restore_interrupts(ints);
+	return stats;
+}
+
+uint gps_get_baud()
+{
+	return link_baud;
+}
+
+uint8_t gps_get_fix_type()
+{
+	return fix_type;
 }
 
 uint32_t gps_get_time_accuracy_ns()
 {
-	return time_accuracy;
+	return clock_state.read().accuracy_ns;
 }
 
 void gps_on_pps()
 {
-	last_pps_time_us = to_us_since_boot(get_absolute_time());
+	Pps_Time edge = pps_capture_edge();
+	last_pps_time_us = edge.us;
+	last_pps_frac    = edge.frac;
+
+	// Only use a qErr that arrived since the last edge, so it's for this one
+	last_pps_qerr_ps    = next_pps_qerr_valid ? next_pps_qerr_ps : 0;
+	next_pps_qerr_valid = false;
+
+	// Flash operations keep interrupts off, so an edge during one is
+	// timestamped when it ends if capture isn't running, or has already
+	// moved on to the next.  Don't trust the edge after any of them.
+	uint32_t flash_ops = flash_window_operations();
+	last_pps_trusted = flash_ops == pps_flash_ops;
+	pps_flash_ops    = flash_ops;
 }
@@ -1,12 +1,84 @@
 #pragma once
 #include "pico/stdlib.h"
 #include "hardware/uart.h"
+#include "clock_servo.hpp"
+#include "config.hpp"
 #include "time.hpp"
+#include "ubx_tx.hpp"
 #include <array>
+#include <span>
 #include <string_view>
 
+// How often the receiver sends a message, per navigation solution.  0 is off.
+struct Gps_Message_Rate
+{
+	uint8_t cls;
+	uint8_t id;
+	uint8_t rate;
+};
+
+// Delay from a PPS edge until the message with its time was handled
+struct Gps_Latency
+{
+	uint32_t count;
+	uint32_t last_us;
+	uint32_t min_us;
+	uint32_t max_us;
+	uint64_t total_us;
+};
+
+// Everything the display needs from the GPS.  Published as one piece, so
+// the offset, accuracy and PPS time always come from the same fix.
+struct Clock_State
+{
+	bool        valid       = false;  // We know the time
+	bool        locked      = false;  // ...and have followed the PPS for a while
+	Clock_Model model;
+	uint32_t    accuracy_ns = 0xFFFFFFFF;
+	uint64_t    last_pps_us = 0;      // Hardware time of the last PPS edge used
+	// How the last fix went, for telemetry
+	int32_t     error_ns       = 0;   // Phase error at the last PPS edge, before correction
+	int32_t     drift_ppb      = 0;
+	uint32_t    pps_latency_us = 0;   // PPS edge to the message with its time
+	// The model's time runs straight through a leap second; this turns it
+	// back into UTC once past leap.start.  See Leap_Event.
+	Leap_Event  leap;
+
+	// UTC minus hardware time at hw_us, or 0 if we don't know the time.  Past
+	// leap.start, it's leap.to_utc() that gives UTC.
+	uint64_t offset_us(uint64_t hw_us) const { return valid ? model.offset_us(hw_us) : 0; }
+};
+
 void gps_init_io(uart_inst_t* uart, uint baud, uint rx_pin, uint tx_pin);
-void gps_init_comms();
+// Pick up from the state saved last time: the crystal's drift, the leap
+// seconds, and how the receiver was left.  Call before gps_init_comms.
+void gps_warm_start(const Warm_State& state);
+// Find the receiver at whatever baud it's using, move it to baud, and queue
+// the configuration.  Doesn't wait for the receiver to accept it; see
+// gps_get_tx_stats().  Skipped if the receiver still has this configuration
+// from before a warm start.  Returns false if the receiver can't be found.
+bool gps_init_comms(uint baud, std::span<const Gps_Message_Rate> rates);
+void gps_set_message_rate(uint8_t cls, uint8_t id, uint8_t rate);
+void gps_set_nav_rate(uint16_t period_ms);
+// Spread leap seconds over the 24 hours around them instead of showing
+// 23:59:60.  Applies from the next UBX-NAV-TIMELS, unless one's under way.
+void gps_set_leap_smear(bool smear);
+// Handle any messages received since the last call.  Call often; the
+// receive ring holds about 200ms at 115200 baud.
+void gps_poll();
 void gps_on_pps();
-uint64_t gps_get_clock_offset_us();
+// State worth saving for a warm start.  Returns false until the clock locks.
+bool gps_get_warm_state(Warm_State& state);
+// Latest clock state.  Never blocks, so safe from any interrupt or core.
+Clock_State gps_get_clock_state();
+// UTC minus hardware time at hw_time_us, or 0 if we don't know the time
+uint64_t gps_get_clock_offset_us(uint64_t hw_time_us);
+// Estimated crystal frequency error.  Positive means it runs fast.
+int32_t  gps_get_drift_ppb();
 uint32_t gps_get_time_accuracy_ns();
+// From NAV-STATUS: 0 none, 2 2D, 3 3D, 5 time only
+uint8_t  gps_get_fix_type();
+Gps_Latency gps_get_latency();
+uint gps_get_baud();
+// Counts of config messages sent, answered, retried and given up on
+Ubx_Tx_Queue::Stats gps_get_tx_stats();
@@ -0,0 +1,325 @@
+// Host benchmarks for the 1 kHz render path.  Times are host nanoseconds,
+// so only compare them against other runs on the same machine.
+#include "hal.hpp"
+#include "config.hpp"
+#include "display.hpp"
+#include "gps.hpp"
+#include "time.hpp"
+#include "time_zone.hpp"
+#include "timing.hpp"
+#include "ubx.hpp"
+#include "ubx_parser.hpp"
+#include <chrono>
+#include <cstring>
+#include <random>
+
+extern Config config;
+int64_t do_every_ms(alarm_id_t id, void *user_data);
+
+static volatile uint32_t sink;
+
+// Run `fn(i)` `iterations` times, a few rounds over, and report the best round
+template <typename F>
+static void bench(const char* name, uint iterations, F&& fn)
+{
+	using namespace std::chrono;
+	constexpr int rounds = 5;
+	double best_ns = 1e30;
+	for (int round = 0; round < rounds; round++)
+	{
+		auto start = steady_clock::now();
+		for (uint i = 0; i < iterations; i++)
+			fn(i);
+		double ns = duration<double, std::nano>(steady_clock::now() - start).count() / iterations;
+		best_ns = std::min(best_ns, ns);
+	}
+	printf("%-28s %10.1f ns/frame\n", name, best_ns);
+}
+
+// Wrap a payload up as a UBX frame
+static std::vector<uint8_t> ubx_frame(uint8_t cls, uint8_t id, std::span<const uint8_t> payload)
+{
+	std::vector<uint8_t> frame(payload.size() + 8);
+	frame[0] = 0xB5;
+	frame[1] = 0x62;
+	frame[2] = cls;
+	frame[3] = id;
+	frame[4] = payload.size() & 0xFF;
+	frame[5] = payload.size() >> 8;
+	std::copy(payload.begin(), payload.end(), frame.begin() + 6);
+	uint8_t ck_a = 0, ck_b = 0;
+	for (size_t i = 2; i < frame.size() - 2; i++)
+	{
+		ck_a += frame[i];
+		ck_b += ck_a;
+	}
+	frame[frame.size()-2] = ck_a;
+	frame[frame.size()-1] = ck_b;
+	return frame;
+}
+
+// Give the GPS code a PPS edge and a valid NAV-TIMEUTC, so the full date path is rendered
+static void sync_gps()
+{
+	gps_on_pps();
+	host_advance_us(50'000);
+
+	uint8_t payload[20] = {};
+	uint32_t t_acc = 50;  // ns
+	uint16_t year  = 2025;
+	std::memcpy(&payload[4],  &t_acc, 4);
+	std::memcpy(&payload[12], &year,  2);
+	payload[14] = 6;     // Month
+	payload[15] = 30;    // Day
+	payload[16] = 23;    // Hour
+	payload[17] = 59;    // Minute
+	payload[18] = 30;    // Second
+	payload[19] = 0x07;  // Valid TOW, WKN, UTC
+	host_uart_rx(uart1, ubx_frame(0x01, 0x21, payload));
+	gps_poll();
+}
+
+// The byte-at-a-time UART interrupt state machine the ring parser replaced
+static std::array<uint8_t, 32> legacy_buf;
+static uint legacy_pos = legacy_buf.size();
+
+static void legacy_feed(uint8_t ch, void (*handler)(std::span<uint8_t>))
+{
+	if (legacy_pos == 0 && ch != 0xB5)
+		return;
+	if (legacy_pos == 1 && ch != 0x62)
+	{
+		legacy_pos = 0;
+		return;
+	}
+	if (legacy_pos >= legacy_buf.size())
+	{
+		legacy_pos = 0;
+		return;
+	}
+
+	legacy_buf[legacy_pos++] = ch;
+	if (legacy_pos > 6)
+	{
+		uint16_t len = legacy_buf[4] | (legacy_buf[5] << 8);
+		if (legacy_pos == len + 8u)
+		{
+			handler(std::span(legacy_buf.data()+2, len+6));
+			legacy_pos = 0;
+		}
+	}
+}
+
+static uint32_t frames_seen;
+
+static void count_frame(std::span<uint8_t> msg)
+{
+	frames_seen++;
+}
+
+// The hand-written decode chain the dispatch table replaced
+template <typename T>
+static T read_bytes(std::span<uint8_t>& data)
+{
+	T value;
+	std::memcpy(&value, data.data(), sizeof(T));
+	data = data.subspan(sizeof(T));
+	return value;
+}
+
+static void legacy_decode(std::span<uint8_t> msg)
+{
+	uint8_t cls = read_bytes<uint8_t>(msg);
+	uint8_t id  = read_bytes<uint8_t>(msg);
+	read_bytes<uint16_t>(msg);
+	if (cls == 0x01 && id == 0x21 && msg.size() == 20)
+	{
+		read_bytes<uint32_t>(msg);
+		uint32_t tacc  = read_bytes<uint32_t>(msg);
+		int32_t  nano  = read_bytes<int32_t>(msg);
+		uint16_t dy    = read_bytes<uint16_t>(msg);
+		uint8_t  dm    = read_bytes<uint8_t>(msg);
+		uint8_t  dd    = read_bytes<uint8_t>(msg);
+		uint8_t  th    = read_bytes<uint8_t>(msg);
+		uint8_t  tm    = read_bytes<uint8_t>(msg);
+		uint8_t  ts    = read_bytes<uint8_t>(msg);
+		uint8_t  valid = read_bytes<uint8_t>(msg);
+		sink = tacc + nano + dy + dm + dd + th + tm + ts + valid;
+	}
+}
+
+template <typename M>
+static void sink_message(const M& msg)
+{
+	sink = msg.cls;
+}
+
+static void sink_timeutc(const Ubx_Nav_TimeUTC& msg)
+{
+	sink = msg.tAcc + msg.nano + msg.year + msg.month + msg.day + msg.hour + msg.min + msg.sec + msg.valid;
+}
+
+// Same table as gps.cpp, with handlers that only read the fields
+static constexpr std::array bench_handlers = {
+	ubx_dispatch_entry<Ubx_Nav_Status,  sink_message>(),
+	ubx_dispatch_entry<Ubx_Nav_TimeUTC, sink_timeutc>(),
+	ubx_dispatch_entry<Ubx_Nav_TimeLS,  sink_message>(),
+	ubx_dispatch_entry<Ubx_Ack_Nak,     sink_message>(),
+	ubx_dispatch_entry<Ubx_Ack_Ack,     sink_message>(),
+	ubx_dispatch_entry<Ubx_Tim_TP,      sink_message>(),
+};
+
+static void bench_ubx_decode()
+{
+	std::array<uint8_t, 20> payload = {};
+	payload[19] = 0x07;
+	auto frame = ubx_frame(0x01, 0x21, payload);
+	std::span<uint8_t> msg(frame.data() + 2, frame.size() - 4);
+
+	bench("ubx decode legacy", 1'000'000, [&](uint i) {
+		legacy_decode(msg);
+	});
+	bench("ubx decode dispatch table", 1'000'000, [&](uint i) {
+		ubx_dispatch(bench_handlers, msg);
+	});
+}
+
+// Parse a noisy stream of frames of all sizes, old way and new
+static void bench_ubx_parsers()
+{
+	std::mt19937 rng(1);
+	std::vector<uint8_t> stream;
+	uint32_t frames_sent = 0, small_sent = 0;
+	while (stream.size() < 4'000'000)
+	{
+		// Some line noise, then a frame.  Mostly small, like NAV-TIMEUTC.
+		for (uint n = rng() % 16; n > 0; n--)
+			stream.push_back(rng());
+		std::vector<uint8_t> payload(rng() % 4 ? rng() % 24 : rng() % (Ubx_Ring_Parser::max_payload + 1));
+		for (uint8_t& b : payload)
+			b = rng();
+		auto frame = ubx_frame(rng(), rng(), payload);
+		stream.insert(stream.end(), frame.begin(), frame.end());
+		frames_sent++;
+		small_sent += frame.size() <= legacy_buf.size();
+	}
+
+	using namespace std::chrono;
+	frames_seen = 0;
+	auto start = steady_clock::now();
+	for (uint8_t b : stream)
+		legacy_feed(b, count_frame);
+	double legacy_ns = duration<double, std::nano>(steady_clock::now() - start).count();
+	printf("%-28s %10.2f ns/byte  %u/%u frames (%u fit its buffer)\n", "ubx legacy state machine",
+		legacy_ns / stream.size(), frames_seen, frames_sent, small_sent);
+
+	// Fed in DMA-sized bursts, as gps_poll would see them
+	alignas(2048) static std::array<uint8_t, 2048> ring;
+	Ubx_Ring_Parser parser(ring);
+	frames_seen = 0;
+	static uint32_t written;
+	written = 0;
+	start = steady_clock::now();
+	for (size_t pos = 0; pos < stream.size(); pos += 64)
+	{
+		for (size_t i = pos; i < std::min(pos + 64, stream.size()); i++)
+			ring[written++ % ring.size()] = stream[i];
+		parser.parse([] { return written; }, count_frame);
+	}
+	double ring_ns = duration<double, std::nano>(steady_clock::now() - start).count();
+	printf("%-28s %10.2f ns/byte  %u/%u frames, %u bad\n", "ubx ring parser",
+		ring_ns / stream.size(), frames_seen, frames_sent, parser.bad_frames);
+}
+
+// Send frames the way do_every_ms does, latch then send, once a period, and
+// count the latches that find the last frame still shifting out.  Timing
+// comes from the host's PIO model, so this checks the budget, not speed.
+static void bench_frame_budget()
+{
+	for (uint period_us : {1000u, 100u})
+	{
+		for (uint bit_rate : {1'000'000u, 4'000'000u, 10'000'000u})
+		{
+			disp_set_bit_rate(bit_rate);
+			host_advance_us(1000);  // Let the last frame finish
+			constexpr uint frames = 10'000;
+			uint32_t overruns = disp_overruns();
+			for (uint i = 0; i < frames; i++)
+			{
+				disp_latch();
+				disp_frame_load(i % 1000, 3);
+				disp_send(false);
+				host_advance_us(period_us);
+			}
+			printf("frame budget %5uHz %4.1fMHz   %6.1f us/frame  %5u/%u overruns\n", 1'000'000 / period_us,
+				bit_rate / 1e6, disp_frame_time_ns() / 1e3, (uint)(disp_overruns() - overruns), frames);
+		}
+	}
+	disp_set_bit_rate(1'000'000);
+}
+
+int main()
+{
+	host_set_time_us(10'000'000);
+	timing_init();
+	gps_init_io(uart1, 9600, 5, 4);
+	disp_init(pio0, 11, 10, 9);
+	config.time_zone  = 0;
+	config.brightness = 64;
+	sync_gps();
+
+	constexpr uint frames = 1'000'000;
+	using namespace std::chrono;
+	Time_us base = sys_days{year{2025} / 6 / 30} + hours{23};
+
+	bench("time_split", frames, [&](uint i) {
+		Time_Parts parts = time_split(base + milliseconds(i));
+		sink = parts.millisecond;
+	});
+
+	Time_Ticker ticker;
+	bench("Time_Ticker::advance_to", frames, [&](uint i) {
+		ticker.advance_to(base + milliseconds(i));
+		sink = ticker.parts().millisecond;
+	});
+
+	// A zone with summer time, evaluated every frame and cached
+	Tz_Rule rule;
+	tz_parse("CET-1CEST,M3.5.0,M10.5.0/3", rule);
+	bench("tz_span_at", frames, [&](uint i) {
+		sink = tz_span_at(rule, base + milliseconds(i)).utc_offset_s;
+	});
+
+	Tz_Cache zone;
+	zone.set(rule);
+	bench("Tz_Cache::at", frames, [&](uint i) {
+		sink = zone.at(base + milliseconds(i)).utc_offset_s;
+	});
+
+	bench("gps_get_clock_offset_us", frames, [](uint i) {
+		sink = gps_get_clock_offset_us(time_us_64() + i);
+	});
+
+	bench("disp_set_brightness", frames, [](uint i) {
+		disp_set_brightness(i & 0x7f);
+	});
+
+	bench("disp_set_num x17", frames, [](uint i) {
+		disp_clear();
+		for (uint digit = 1; digit < 18; digit++)
+			disp_set_num(digit, (i + digit) % 10, false);
+	});
+
+	// The alarm body, with the clock stepping 1ms per frame.  Advancing runs
+	// the display DMA's completion, so each latch finds its frame done.
+	bench("do_every_ms", frames, [](uint i) {
+		host_advance_us(1000);
+		sink = do_every_ms(0, nullptr);
+	});
+
+	bench_ubx_decode();
+	bench_ubx_parsers();
+	bench_frame_budget();
+
+	return 0;
+}
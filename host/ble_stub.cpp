@@ -0,0 +1,22 @@
+// Host stand-in for ble.cpp; BTstack and the cyw43 radio aren't available off-target.
+#include "ble.hpp"
+
+static std::function<void(BLECommand, int32_t, std::string_view)> command_cb;
+
+void ble_init()
+{
+}
+
+void ble_tick_time(const BLE_Time& time)
+{
+}
+
+void ble_set_command_cb(std::function<void(BLECommand, int32_t, std::string_view)> cb)
+{
+	command_cb = cb;
+}
+
+uint8_t ble_get_id()
+{
+	return 0x5A;
+}
@@ -0,0 +1,144 @@
+// Seqlock and Spsc_Queue between two real threads.  The host has weaker
+// memory ordering than the M0+ on some machines, and a second core running
+// flat out, so this is harsher than the clock ever is.
+#include "seqlock.hpp"
+#include "spsc_queue.hpp"
+#include "test.hpp"
+#include <atomic>
+#include <thread>
+
+// Big enough that a copy takes a while, so even on a single CPU a thread
+// is sometimes switched out halfway.  Every word is derived from one number,
+// so a mix of two writes shows.
+struct Sample
+{
+	uint64_t words[64];
+
+	static Sample make(uint64_t n)
+	{
+		Sample s;
+		for (int i = 0; i < 64; i++)
+			s.words[i] = n * 0x9E3779B97F4A7C15 + i;
+		return s;
+	}
+	uint64_t number() const { return words[0] * 0xF1DE83E19937733D; }  // Inverse of the multiplier
+	bool whole() const { return *this == make(number()); }
+	bool operator==(const Sample&) const = default;
+};
+
+static void test_seqlock()
+{
+	static constexpr uint64_t writes = 2'000'000;
+	Seqlock<Sample> lock;
+	lock.write(Sample::make(0));
+	std::atomic<bool> done{false};
+
+	std::thread writer([&] {
+		for (uint64_t n = 1; n <= writes; n++)
+			lock.write(Sample::make(n));
+		done = true;
+	});
+
+	uint64_t reads = 0, torn = 0, backwards = 0, last = 0;
+	while (!done)
+	{
+		Sample s = lock.read();
+		reads++;
+		if (!s.whole())
+			torn++;
+		else if (s.number() < last)
+			backwards++;
+		else
+			last = s.number();
+	}
+	writer.join();
+
+	CHECK(torn == 0, "%llu of %llu reads torn", (unsigned long long)torn, (unsigned long long)reads);
+	CHECK(backwards == 0, "%llu reads went back in time", (unsigned long long)backwards);
+	CHECK(lock.read() == Sample::make(writes));
+	printf("seqlock: %llu reads during %llu writes\n", (unsigned long long)reads, (unsigned long long)writes);
+}
+
+// A producer that never waits, like the ones in interrupts: each item either
+// arrives once, in order, or is counted as dropped
+static void test_queue_dropping()
+{
+	static constexpr uint64_t pushes = 2'000'000;
+	Spsc_Queue<Sample, 16> queue;
+	std::atomic<bool> done{false};
+
+	std::thread producer([&] {
+		for (uint64_t n = 1; n <= pushes; n++)
+		{
+			queue.push(Sample::make(n));
+			if (n % 64 == 0)
+				std::this_thread::yield();  // Give a single CPU's consumer a look in
+		}
+		done = true;
+	});
+
+	uint64_t received = 0, torn = 0, repeated = 0, last = 0;
+	auto drain = [&] {
+		Sample s;
+		while (queue.pop(s))
+		{
+			received++;
+			if (!s.whole())
+				torn++;
+			else if (s.number() <= last)
+				repeated++;
+			else
+				last = s.number();
+		}
+	};
+	while (!done)
+	{
+		drain();
+		std::this_thread::yield();
+	}
+	producer.join();
+	drain();
+
+	CHECK(torn == 0, "%llu items torn", (unsigned long long)torn);
+	CHECK(repeated == 0, "%llu items repeated or out of order", (unsigned long long)repeated);
+	CHECK(received + queue.drops() == pushes, "%llu received + %u dropped != %llu pushed",
+		(unsigned long long)received, (unsigned)queue.drops(), (unsigned long long)pushes);
+	printf("queue: %llu received, %u dropped\n", (unsigned long long)received, (unsigned)queue.drops());
+}
+
+// A producer that retries when full loses nothing
+static void test_queue_lossless()
+{
+	static constexpr uint64_t pushes = 2'000'000;
+	Spsc_Queue<Sample, 16> queue;
+
+	std::thread producer([&] {
+		for (uint64_t n = 1; n <= pushes; n++)
+			while (!queue.push(Sample::make(n)))
+				std::this_thread::yield();  // A single CPU would spin out its whole time slice
+	});
+
+	uint64_t expected = 1, wrong = 0;
+	Sample s;
+	while (expected <= pushes)
+		if (queue.pop(s))
+		{
+			if (s != Sample::make(expected))
+				wrong++;
+			expected = s.number() + 1;
+		}
+		else
+			std::this_thread::yield();
+	producer.join();
+
+	CHECK(wrong == 0, "%llu items missing, repeated or torn", (unsigned long long)wrong);
+	CHECK(!queue.pop(s), "extra item after the last");
+}
+
+int main()
+{
+	test_seqlock();
+	test_queue_dropping();
+	test_queue_lossless();
+	return test_result("concurrency_test");
+}
@@ -0,0 +1,111 @@
+// Saved settings across layout versions: records written by older firmware,
+// straight into the flash log where config.cpp keeps them.
+#include "hal.hpp"
+#include "config.hpp"
+#include "flash_log.hpp"
+#include "timing.hpp"
+#include "test.hpp"
+#include <cstring>
+#include <string_view>
+
+// Where config.cpp's log is
+static constexpr uint32_t log_offset  = PICO_FLASH_SIZE_BYTES - 6 * FLASH_SECTOR_SIZE;
+static constexpr uint32_t log_sectors = 4;
+
+static void erase_log()
+{
+	std::memset(host_flash + log_offset, 0xff, log_sectors * FLASH_SECTOR_SIZE);
+}
+
+static void save_raw(uint8_t key, uint8_t version, std::span<const uint8_t> payload)
+{
+	Flash_Log log(log_offset, log_sectors);
+	log.init();
+	CHECK(log.write(key, version, payload));
+}
+
+static Config load()
+{
+	config_init();
+	Config config;
+	config_read_from_flash(config);
+	return config;
+}
+
+static std::string_view rule(const Config& config)
+{
+	return std::string_view(config.time_zone_rule, strnlen(config.time_zone_rule, sizeof(config.time_zone_rule)));
+}
+
+// The first version 1 records were 8 bytes, and the 3 after brightness were
+// padding, where the rule is in the longer ones
+static void test_v1_short()
+{
+	erase_log();
+	const uint8_t record[8] = {2, 0, 0, 0, 99, 'E', 'S', 'T'};
+	save_raw(0, 1, record);
+	Config config = load();
+	CHECK(config.time_zone == 2 && config.brightness == 99);
+	CHECK(rule(config).empty(), "padding loaded as rule \"%.*s\"", (int)rule(config).size(), rule(config).data());
+	CHECK(config.leap_smear == 0);
+}
+
+static void test_v1_full()
+{
+	erase_log();
+	uint8_t record[48];
+	std::memset(record, 0xAA, sizeof(record));  // Padding, as it might have been
+	record[0] = uint8_t(-5);
+	record[1] = record[2] = record[3] = 0xff;
+	record[4] = 32;
+	std::memset(record + 5, 0, 40);
+	std::string_view tz = "CET-1CEST,M3.5.0,M10.5.0/3";
+	tz.copy((char*)record + 5, tz.size());
+	record[45] = 1;
+	save_raw(0, 1, record);
+
+	Config config = load();
+	CHECK(config.time_zone == -5 && config.brightness == 32);
+	CHECK(rule(config) == tz);
+	CHECK(config.leap_smear == 1);
+
+	// Before leap_smear, its byte was padding
+	record[45] = 0xAA;
+	save_raw(0, 1, record);
+	CHECK(load().leap_smear == 0);
+}
+
+static void test_round_trip()
+{
+	erase_log();
+	Config config;
+	config.time_zone  = 9;
+	config.brightness = 200;
+	config.leap_smear = 1;
+	std::string_view tz = "AEST-10AEDT,M10.1.0,M4.1.0/3";
+	tz.copy(config.time_zone_rule, tz.size());
+	config_init();
+	config_write_to_flash(config);
+	Config loaded = load();
+	CHECK(std::memcmp(&loaded, &config, sizeof(config)) == 0);
+
+	// A newer layout than this firmware knows is left alone
+	save_raw(0, Config::version + 1, std::span((const uint8_t*)&config, sizeof(config)));
+	CHECK(load().brightness == Config().brightness);
+
+	Warm_State warm = {.utc_us = 1'740'787'200'000'000, .drift_ppb = -12'345, .fingerprint = 0x1234, .baud = 115200, .leap_s = 18};
+	config_init();  // Pick up the record written behind its back
+	config_write_warm_state(warm);
+	Warm_State warm_loaded;
+	CHECK(config_read_warm_state(warm_loaded));
+	CHECK(std::memcmp(&warm_loaded, &warm, sizeof(warm)) == 0);
+}
+
+int main()
+{
+	timing_init();
+	test_v1_short();
+	test_v1_full();
+	test_round_trip();
+	return test_result("config_test");
+}
@@ -0,0 +1,50 @@
+// When the display says a frame is done.  The DMA finishes a few words
+// before the state machine does, and the state machine stalls waiting for
+// the first word, too, so it's only done once the last bit is out.
+#include "hal.hpp"
+#include "display.hpp"
+#include "timing.hpp"
+#include "test.hpp"
+
+// Microseconds from now until disp_frame_done(), stepping one at a time
+static uint64_t until_done_us()
+{
+	uint64_t start_us = time_us_64();
+	while (!disp_frame_done() && time_us_64() - start_us < 1000)
+		host_advance_us(1);
+	return time_us_64() - start_us;
+}
+
+// Send a frame, or two back to back, and check it's done when the last one
+// has shifted out, and not before
+static void check_frame(const char* what, uint frames, uint64_t frame_ns)
+{
+	for (uint i = 0; i < frames; i++)
+		disp_send(true);
+	uint32_t overruns = disp_overruns();
+
+	// Some way in, the DMA's done with it but the shift isn't
+	host_advance_us(frame_ns * frames / 1000 - 2);
+	CHECK(!disp_latch(), "%s: latched before the end", what);
+	CHECK(disp_overruns() == overruns + 1);
+
+	uint64_t done_us = until_done_us();
+	CHECK(done_us >= 2 && done_us <= 3, "%s: done %lluus later, not 2", what, (unsigned long long)done_us);
+	CHECK(disp_latch(), "%s: no latch once done", what);
+}
+
+int main()
+{
+	host_set_time_us(1'000'000);
+	timing_init();
+	disp_init(pio0, 11, 10, 9);
+	disp_set_brightness(64);
+
+	// The first frame has the brightness commands too
+	check_frame("first", 1, disp_frame_time_ns(true));
+	check_frame("on/off", 1, disp_frame_time_ns(false));
+	host_advance_us(100);
+	check_frame("after a pause", 1, disp_frame_time_ns(false));
+	check_frame("queued behind another", 2, disp_frame_time_ns(false));
+	return test_result("display_test");
+}
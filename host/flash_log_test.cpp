@@ -0,0 +1,99 @@
+// Flash_Log against power cuts.  Every write of a long run is repeated with
+// the power cut after each byte it programs or erases, and a fresh
+// Flash_Log::init() has to find the old value or the new one, and carry on.
+#include "hal.hpp"
+#include "flash_log.hpp"
+#include "timing.hpp"
+#include "test.hpp"
+#include <cstring>
+#include <optional>
+#include <vector>
+
+static constexpr uint32_t log_offset  = 0;
+static constexpr uint32_t log_sectors = 4;
+static constexpr uint32_t log_size    = log_sectors * FLASH_SECTOR_SIZE;
+
+// Saved only at the start, like settings usually are, so its record gets
+// carried out of the first sector before that's erased
+static constexpr uint8_t rare_key  = 0;
+static constexpr uint8_t often_key = 1;
+
+// Distinct contents for each write, of a different length per key
+static std::vector<uint8_t> payload(uint8_t key, uint32_t n)
+{
+	std::vector<uint8_t> data(key == rare_key ? Flash_Log::max_payload : 24);
+	for (size_t i = 0; i < data.size(); i++)
+		data[i] = uint8_t(n * 31 + i + key * 7);
+	return data;
+}
+
+static bool holds(const Flash_Log& log, uint8_t key, std::optional<uint32_t> n)
+{
+	uint8_t version;
+	std::span<const uint8_t> data;
+	if (!log.read(key, version, data))
+		return !n;
+	std::vector<uint8_t> want = payload(key, n.value_or(0));
+	return n && version == key + 1 && std::equal(data.begin(), data.end(), want.begin(), want.end());
+}
+
+static Flash_Log recover()
+{
+	Flash_Log log(log_offset, log_sectors);
+	log.init();
+	return log;
+}
+
+int main()
+{
+	timing_init();
+	std::memset(host_flash + log_offset, 0xff, log_size);
+
+	Flash_Log log(log_offset, log_sectors);
+	log.init();
+	std::optional<uint32_t> current[2];  // Write number each key holds
+	uint32_t cuts = 0;
+
+	// Enough to go round the sectors and erase them all
+	for (uint32_t n = 0; n < 300; n++)
+	{
+		uint8_t key = n == 0 ? rare_key : often_key;
+		std::vector<uint8_t> data = payload(key, n);
+		std::vector<uint8_t> before(host_flash + log_offset, host_flash + log_offset + log_size);
+
+		for (int64_t cut_after = 0;; cut_after++)
+		{
+			std::memcpy(host_flash + log_offset, before.data(), log_size);
+			Flash_Log attempt = log;
+			host_flash_cut_power_after(cut_after);
+			attempt.write(key, key + 1, data);
+			bool cut = host_flash_power_was_cut();
+			host_flash_cut_power_after(-1);
+			if (!cut)
+				break;  // The write got through in full
+			cuts++;
+
+			Flash_Log recovered = recover();
+			for (uint8_t k : {rare_key, often_key})
+				CHECK(holds(recovered, k, current[k]) || (k == key && holds(recovered, k, n)),
+					"write %u cut after %lld bytes: key %u lost", n, (long long)cut_after, k);
+
+			// And it carries on from there
+			CHECK(recovered.write(key, key + 1, payload(key, n + 1)),
+				"write %u cut after %lld bytes: next write failed", n, (long long)cut_after);
+			CHECK(holds(recover(), key, n + 1),
+				"write %u cut after %lld bytes: next write not found", n, (long long)cut_after);
+		}
+
+		std::memcpy(host_flash + log_offset, before.data(), log_size);
+		CHECK(log.write(key, key + 1, data), "write %u failed", n);
+		current[key] = n;
+		CHECK(holds(recover(), key, n), "write %u not found", n);
+	}
+
+	// The run has to have gone through the interesting parts
+	CHECK(log.stats.erases >= log_sectors, "only %u erases", log.stats.erases);
+	CHECK(log.stats.carried > 0, "nothing carried forward");
+	printf("flash_log: %u power cuts, %u erases, %u records carried\n", cuts, log.stats.erases, log.stats.carried);
+	return test_result("flash_log_test");
+}
@@ -0,0 +1,202 @@
+#pragma once
+// A stand-in GPS receiver for host tests: UBX frames as the receiver sends
+// them, and a PPS source on a hardware clock that runs fast or slow.
+#include "hal.hpp"
+#include "gps.hpp"
+#include "time.hpp"
+#include <cstring>
+#include <span>
+#include <vector>
+
+// Wrap a payload up as a UBX frame
+inline std::vector<uint8_t> ubx_frame(uint8_t cls, uint8_t id, std::span<const uint8_t> payload)
+{
+	std::vector<uint8_t> frame(payload.size() + 8);
+	frame[0] = 0xB5;
+	frame[1] = 0x62;
+	frame[2] = cls;
+	frame[3] = id;
+	frame[4] = payload.size() & 0xFF;
+	frame[5] = payload.size() >> 8;
+	std::copy(payload.begin(), payload.end(), frame.begin() + 6);
+	uint8_t ck_a = 0, ck_b = 0;
+	for (size_t i = 2; i < frame.size() - 2; i++)
+	{
+		ck_a += frame[i];
+		ck_b += ck_a;
+	}
+	frame[frame.size()-2] = ck_a;
+	frame[frame.size()-1] = ck_b;
+	return frame;
+}
+
+// NAV-TIMEUTC for the second starting at utc, valid unless told otherwise.
+// second_60 labels it 23:59:60 of the day before utc.
+inline std::vector<uint8_t> nav_timeutc_frame(Time_us utc, bool second_60 = false, uint8_t valid = 0x07,
+	uint32_t t_acc_ns = 50, uint32_t itow_ms = 0)
+{
+	using namespace std::chrono;
+	if (second_60)
+		utc -= seconds(1);
+	sys_days day = floor<days>(utc);
+	year_month_day date{day};
+	hh_mm_ss time{floor<seconds>(utc - day)};
+	uint8_t payload[20] = {};
+	uint16_t year_ = int(date.year());
+	std::memcpy(&payload[0],  &itow_ms, 4);
+	std::memcpy(&payload[4],  &t_acc_ns, 4);
+	std::memcpy(&payload[12], &year_, 2);
+	payload[14] = unsigned(date.month());
+	payload[15] = unsigned(date.day());
+	payload[16] = time.hours().count();
+	payload[17] = time.minutes().count();
+	payload[18] = time.seconds().count() + (second_60 ? 1 : 0);
+	payload[19] = valid;
+	return ubx_frame(0x01, 0x21, payload);
+}
+
+inline void send_nav_timeutc(Time_us utc, bool second_60 = false, uint8_t valid = 0x07, uint32_t t_acc_ns = 50)
+{
+	host_uart_rx(uart1, nav_timeutc_frame(utc, second_60, valid, t_acc_ns));
+	gps_poll();
+}
+
+// NAV-TIMELS announcing a leap second seconds_to_event from now
+inline void send_nav_timels(int8_t change, int32_t seconds_to_event)
+{
+	uint8_t payload[24] = {};
+	payload[9]  = 18;      // Current leap seconds
+	payload[11] = change;
+	std::memcpy(&payload[12], &seconds_to_event, 4);
+	payload[23] = 0x03;    // Both valid
+	host_uart_rx(uart1, ubx_frame(0x01, 0x26, payload));
+	gps_poll();
+}
+
+// PPS edges from a receiver whose seconds are counted from hardware time
+// hw_start_us, on a crystal drift_ppb fast, plus whatever phase step has
+// been applied.  The host clock only goes forward, so edges come in order.
+struct Pps_Source
+{
+	uint64_t hw_start_us;
+	double   drift_ppb = 0;
+	double   phase_us  = 0;
+
+	// Hardware time of the edge n seconds in
+	uint64_t hw_at(int64_t n) const
+	{
+		return hw_start_us + uint64_t(n * 1e6 * (1 + drift_ppb * 1e-9) + phase_us + 0.5);
+	}
+
+	// Edge n, then latency_us later the NAV-TIMEUTC saying it was utc
+	void second(int64_t n, Time_us utc, bool second_60 = false, uint32_t latency_us = 50'000)
+	{
+		host_set_time_us(hw_at(n));
+		gps_on_pps();
+		host_advance_us(latency_us);
+		send_nav_timeutc(utc, second_60);
+	}
+};
+
+// A receiver on uart1 that answers what gps_init_comms asks of it, and once
+// it has a fix, sends a PPS edge every whole second of hardware time and,
+// if it's been told to, NAV-TIMEUTC 50ms after.  Bytes only get through when
+// both ends are at the same baud.  It runs off an alarm every millisecond,
+// so it answers while the firmware waits.
+struct Sim_Receiver
+{
+	Time_us  utc_at_zero;          // UTC at hardware time 0
+	int64_t  powered_us   = 0;     // Hardware time it was powered up
+	uint64_t fix_after_us = 0;     // It knows GPS time this long after...
+	uint64_t utc_after_us = 0;     // ...and UTC, once it's heard the leap seconds
+	uint     baud         = 9600;
+	bool     configured   = false; // Sends NAV-TIMEUTC
+	int8_t   leap_s       = 18;
+	int8_t   default_leap_s = 17;  // What it assumes until it's heard
+
+	void start()
+	{
+		add_alarm_in_us(1000 - time_us_64() % 1000, tick, this, true);
+	}
+
+private:
+	std::vector<uint8_t> rx;
+	uint64_t edge_s = 0;  // Last edge sent
+
+	static int64_t tick(alarm_id_t, void* self)
+	{
+		((Sim_Receiver*)self)->run();
+		return 1000;
+	}
+
+	void send(uint8_t cls, uint8_t id, std::span<const uint8_t> payload)
+	{
+		if (host_uart_baud(uart1) == baud)
+			host_uart_rx(uart1, ubx_frame(cls, id, payload));
+	}
+
+	void answer(uint8_t cls, uint8_t id, const std::vector<uint8_t>& payload)
+	{
+		if (cls != 0x06)
+			return;
+		if (id == 0x00 && payload.size() == 1)
+		{	// Poll CFG-PRT
+			uint8_t prt[20] = {0x01};
+			std::memcpy(&prt[8], &baud, 4);
+			send(0x06, 0x00, prt);
+			return;
+		}
+		if (id == 0x00 && payload.size() == 20)
+		{	// Set CFG-PRT: takes the new baud without an answer
+			std::memcpy(&baud, &payload[8], 4);
+			return;
+		}
+		if (id == 0x01 && payload.size() == 3 && payload[0] == 0x01 && payload[1] == 0x21)
+			configured = payload[2] != 0;
+		uint8_t ack[2] = {cls, id};
+		send(0x05, 0x01, ack);
+	}
+
+	void run()
+	{
+		std::vector<uint8_t> sent = host_uart_take_tx(uart1, baud);
+		rx.insert(rx.end(), sent.begin(), sent.end());
+		while (rx.size() >= 8)
+		{
+			if (rx[0] != 0xB5 || rx[1] != 0x62)
+			{
+				rx.erase(rx.begin());
+				continue;
+			}
+			size_t len = rx[4] | rx[5] << 8;
+			if (rx.size() < len + 8)
+				break;
+			std::vector<uint8_t> payload(rx.begin() + 6, rx.begin() + 6 + len);
+			uint8_t cls = rx[2], id = rx[3];
+			rx.erase(rx.begin(), rx.begin() + len + 8);
+			answer(cls, id, payload);
+		}
+
+		using namespace std::chrono;
+		int64_t now_us = time_us_64();
+		if (now_us - powered_us < int64_t(fix_after_us))
+			return;
+		uint64_t second = now_us / 1'000'000;
+		if (now_us % 1'000'000 == 0 && second != edge_s)
+		{
+			edge_s = second;
+			gps_on_pps();
+		}
+		if (now_us % 1'000'000 == 50'000 && second == edge_s && configured)
+		{	// Before it's heard the leap seconds, its UTC is off by the difference
+			bool     utc_known = now_us - powered_us >= int64_t(utc_after_us);
+			Time_us  utc       = utc_at_zero + seconds(second);
+			Time_us  gps       = utc + seconds(leap_s);
+			uint32_t itow_ms   = duration_cast<milliseconds>(gps - sys_days{year{1980} / 1 / 6}).count() % (7 * 86'400'000);
+			Time_us  shown     = gps - seconds(utc_known ? leap_s : default_leap_s);
+			std::vector<uint8_t> frame = nav_timeutc_frame(shown, false, utc_known ? 0x07 : 0x03, 50, itow_ms);
+			if (host_uart_baud(uart1) == baud)
+				host_uart_rx(uart1, frame);
+		}
+	}
+};
@@ -0,0 +1,667 @@
+#include "hal.hpp"
+#include "hardware/dma.h"
+#include "hardware/flash.h"
+#include "hardware/pio.h"
+#include "hardware/sync.h"
+#include "hardware/structs/systick.h"
+#include "hardware/uart.h"
+#include "hardware/clocks.h"
+#include "pps_capture.pio.h"
+#include <array>
+#include <cstring>
+#include <deque>
+#include <optional>
+#include <utility>
+
+// DREQ numbers from here up are UARTs, as on the RP2040
+static constexpr uint dreq_uart_base = 20;
+
+// ---- Time and alarms -------------------------------------------------------
+
+static uint64_t now_us = 0;
+
+static systick_hw_t systick;
+systick_hw_t* const systick_hw = &systick;
+
+// Move the clock, and SysTick with it (counting down at 125MHz)
+static void set_now(uint64_t us)
+{
+	now_us = us;
+	systick.cvr = (0x00FFFFFF - now_us * 125) & 0x00FFFFFF;
+}
+
+struct Alarm
+{
+	alarm_callback_t callback;
+	void*            user_data;
+	uint64_t         target_us;
+};
+static std::vector<Alarm> alarms;
+
+absolute_time_t get_absolute_time()
+{
+	return now_us;
+}
+
+uint64_t time_us_64()
+{
+	return now_us;
+}
+
+uint32_t time_us_32()
+{
+	return uint32_t(now_us);
+}
+
+// Nothing else would move the clock on while the CPU spins
+void tight_loop_contents()
+{
+	host_advance_us(1);
+}
+
+void sleep_ms(uint32_t ms)
+{
+	host_advance_us(ms * 1000ull);
+}
+
+void sleep_us(uint64_t us)
+{
+	host_advance_us(us);
+}
+
+void alarm_pool_init_default()
+{
+}
+
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback, void* user_data, bool fire_if_past)
+{
+	alarms.push_back({callback, user_data, now_us + us});
+	return alarms.size();
+}
+
+void host_set_time_us(uint64_t us)
+{
+	set_now(us);
+}
+
+void host_advance_us(uint64_t us)
+{
+	uint64_t end_us = now_us + us;
+	while (true)
+	{
+		// Find the earliest alarm that's due
+		size_t next = alarms.size();
+		for (size_t i = 0; i < alarms.size(); i++)
+			if (alarms[i].target_us <= end_us && (next == alarms.size() || alarms[i].target_us < alarms[next].target_us))
+				next = i;
+		if (next == alarms.size())
+			break;
+
+		set_now(std::max(now_us, alarms[next].target_us));
+		// The callback may add alarms, so look this one up again afterwards
+		int64_t again = alarms[next].callback(next + 1, alarms[next].user_data);
+		// Same semantics as the SDK: >0 is relative to now, <0 relative to the last target
+		if (again > 0)
+			alarms[next].target_us = now_us + again;
+		else if (again < 0)
+			alarms[next].target_us -= again;
+		else
+			alarms.erase(alarms.begin() + next);
+	}
+	set_now(end_us);
+}
+
+// ---- GPIO and IRQs ---------------------------------------------------------
+
+static gpio_irq_callback_t gpio_callback;
+static std::array<irq_handler_t, NUM_IRQS> irq_handlers;
+
+void gpio_init(uint gpio) {}
+void gpio_set_dir(uint gpio, bool out) {}
+void gpio_put(uint gpio, bool value) {}
+void gpio_set_function(uint gpio, gpio_function fn) {}
+void gpio_set_irq_enabled(uint gpio, uint32_t event_mask, bool enabled) {}
+
+void gpio_set_irq_callback(gpio_irq_callback_t callback)
+{
+	gpio_callback = callback;
+}
+
+// When each pin last went high, for PIO to see
+static std::array<std::optional<uint64_t>, 30> gpio_rise_ns;
+
+void host_gpio_rise_ns(uint gpio, uint64_t at_ns)
+{
+	gpio_rise_ns[gpio] = at_ns;
+}
+
+void host_gpio_irq(uint gpio, uint32_t event_mask)
+{
+	if (gpio_callback)
+		gpio_callback(gpio, event_mask);
+}
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler)
+{
+	irq_handlers[num] = handler;
+}
+
+void irq_set_enabled(uint num, bool enabled) {}
+
+uint32_t save_and_disable_interrupts()
+{
+	return 0;
+}
+
+void restore_interrupts(uint32_t status) {}
+
+// ---- DMA -------------------------------------------------------------------
+
+// If dst is a PIO TX FIFO, run words through its timing model, and return
+// when DMA will have written the last one
+static std::optional<uint64_t> pio_fifo_push(uintptr_t dst, uint words);
+
+struct DMAChannel
+{
+	dma_channel_config config;
+	dma_channel_hw_t   hw;
+	bool               busy;
+	bool               irq0_enabled;
+	std::array<uint32_t, 64> last;
+	uint               last_count;
+};
+static std::array<DMAChannel, 12> dma_channels;
+static uint dma_claimed = 0;
+
+int dma_claim_unused_channel(bool required)
+{
+	return dma_claimed < dma_channels.size() ? dma_claimed++ : -1;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel)
+{
+	return {.dreq = 0x3f, .size = DMA_SIZE_32, .read_increment = true, .write_increment = false};
+}
+
+void channel_config_set_dreq(dma_channel_config* c, uint dreq)
+{
+	c->dreq = dreq;
+}
+
+void channel_config_set_transfer_data_size(dma_channel_config* c, dma_channel_transfer_size size)
+{
+	c->size = size;
+}
+
+void channel_config_set_read_increment(dma_channel_config* c, bool incr)
+{
+	c->read_increment = incr;
+}
+
+void channel_config_set_write_increment(dma_channel_config* c, bool incr)
+{
+	c->write_increment = incr;
+}
+
+void channel_config_set_ring(dma_channel_config* c, bool write, uint size_bits)
+{
+	c->ring_write     = write;
+	c->ring_size_bits = size_bits;
+}
+
+// Paced by a UART; waits for host_uart_rx()
+static bool dma_from_uart(const DMAChannel& ch)
+{
+	return ch.config.dreq >= dreq_uart_base;
+}
+
+static int64_t dma_complete(alarm_id_t id, void* user_data)
+{
+	DMAChannel& ch = *(DMAChannel*)user_data;
+	ch.busy = false;
+	if (ch.irq0_enabled && irq_handlers[DMA_IRQ_0])
+		irq_handlers[DMA_IRQ_0]();
+	return 0;
+}
+
+static void dma_trigger(DMAChannel& ch)
+{
+	ch.busy = ch.hw.transfer_count > 0;
+	if (dma_from_uart(ch))
+		return;
+
+	// Only 32-bit transfers into a FIFO are modelled
+	auto src = (const volatile uint32_t*)ch.hw.read_addr;
+	auto dst = (volatile uint32_t*)ch.hw.write_addr;
+	ch.last_count = std::min<uint>(uint(ch.hw.transfer_count), ch.last.size());
+	for (uint i = 0; i < ch.last_count; i++)
+	{
+		uint32_t word = ch.config.read_increment ? src[i] : src[0];
+		ch.last[i] = word;
+		if (dst)
+			*dst = word;
+	}
+
+	// Into a PIO FIFO, it's done when the state machine has taken all but the last few words
+	if (auto done_ns = pio_fifo_push(ch.hw.write_addr, ch.last_count))
+		add_alarm_in_us((*done_ns + 999) / 1000 - now_us, dma_complete, &ch, true);
+	else
+		dma_complete(0, &ch);
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config* config, volatile void* write_addr,
+	const volatile void* read_addr, uint transfer_count, bool trigger)
+{
+	DMAChannel& ch       = dma_channels[channel];
+	ch.config            = *config;
+	ch.hw.write_addr     = (uintptr_t)write_addr;
+	ch.hw.read_addr      = (uintptr_t)read_addr;
+	ch.hw.transfer_count = transfer_count;
+	if (trigger)
+		dma_trigger(ch);
+}
+
+void dma_channel_set_read_addr(uint channel, const volatile void* read_addr, bool trigger)
+{
+	DMAChannel& ch  = dma_channels[channel];
+	ch.hw.read_addr = (uintptr_t)read_addr;
+	if (trigger)
+		dma_trigger(ch);
+}
+
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger)
+{
+	DMAChannel& ch       = dma_channels[channel];
+	ch.hw.transfer_count = trans_count;
+	if (trigger)
+		dma_trigger(ch);
+}
+
+void dma_channel_abort(uint channel)
+{
+	dma_channels[channel].busy = false;
+}
+
+bool dma_channel_is_busy(uint channel)
+{
+	return dma_channels[channel].busy;
+}
+
+void dma_channel_set_irq0_enabled(uint channel, bool enabled)
+{
+	dma_channels[channel].irq0_enabled = enabled;
+}
+
+void dma_channel_acknowledge_irq0(uint channel)
+{
+}
+
+dma_channel_hw_t* dma_channel_hw_addr(uint channel)
+{
+	return &dma_channels[channel].hw;
+}
+
+std::span<const uint32_t> host_dma_last_transfer(uint channel)
+{
+	return std::span(dma_channels[channel].last.data(), dma_channels[channel].last_count);
+}
+
+// ---- UART ------------------------------------------------------------------
+
+struct uart_inst_t
+{
+	uint      index;
+	uart_hw_t hw;
+	uint      baud;
+	std::deque<uint8_t>  rx;
+	std::vector<uint8_t> tx;
+	std::vector<uint>    tx_baud;  // Each byte went out at
+};
+static uart_inst_t uart_insts[2] = {{0}, {1}};
+uart_inst_t* const uart0 = &uart_insts[0];
+uart_inst_t* const uart1 = &uart_insts[1];
+
+uint uart_get_index(uart_inst_t* uart)
+{
+	return uart->index;
+}
+
+uart_hw_t* uart_get_hw(uart_inst_t* uart)
+{
+	return &uart->hw;
+}
+
+uint uart_get_dreq(uart_inst_t* uart, bool is_tx)
+{
+	return dreq_uart_base + uart->index * 2 + (is_tx ? 0 : 1);
+}
+
+uint uart_init(uart_inst_t* uart, uint baudrate)
+{
+	return uart->baud = baudrate;
+}
+
+uint uart_set_baudrate(uart_inst_t* uart, uint baudrate)
+{
+	return uart->baud = baudrate;
+}
+
+uint host_uart_baud(uart_inst_t* uart)
+{
+	return uart->baud;
+}
+
+void uart_set_hw_flow(uart_inst_t* uart, bool cts, bool rts) {}
+void uart_set_format(uart_inst_t* uart, uint data_bits, uint stop_bits, uart_parity_t parity) {}
+void uart_set_irq_enables(uart_inst_t* uart, bool rx_has_data, bool tx_needs_data) {}
+
+bool uart_is_readable(uart_inst_t* uart)
+{
+	return !uart->rx.empty();
+}
+
+// The TX FIFO drains instantly
+bool uart_is_writable(uart_inst_t* uart)
+{
+	return true;
+}
+
+void uart_putc_raw(uart_inst_t* uart, char c)
+{
+	uart->tx.push_back(c);
+	uart->tx_baud.push_back(uart->baud);
+}
+
+char uart_getc(uart_inst_t* uart)
+{
+	char ch = uart->rx.front();
+	uart->rx.pop_front();
+	return ch;
+}
+
+void uart_write_blocking(uart_inst_t* uart, const uint8_t* src, size_t len)
+{
+	uart->tx.insert(uart->tx.end(), src, src + len);
+	uart->tx_baud.insert(uart->tx_baud.end(), len, uart->baud);
+}
+
+void host_uart_rx(uart_inst_t* uart, std::span<const uint8_t> data)
+{
+	// A busy DMA channel draining the data register gets the bytes first
+	for (DMAChannel& ch : dma_channels)
+	{
+		if (!ch.busy || ch.hw.read_addr != (uintptr_t)&uart->hw.dr)
+			continue;
+
+		uintptr_t ring_mask = ch.config.ring_write ? (uintptr_t(1) << ch.config.ring_size_bits) - 1 : ~uintptr_t(0);
+		for (uint8_t byte : data)
+		{
+			if (ch.hw.transfer_count == 0)
+			{
+				ch.busy = false;
+				break;
+			}
+			*(uint8_t*)ch.hw.write_addr = byte;
+			ch.hw.write_addr = (ch.hw.write_addr & ~ring_mask) | ((ch.hw.write_addr + 1) & ring_mask);
+			ch.hw.transfer_count = ch.hw.transfer_count - 1;
+		}
+		return;
+	}
+
+	uart->rx.insert(uart->rx.end(), data.begin(), data.end());
+	if (irq_handlers[UART_IRQ_NUM(uart)])
+		irq_handlers[UART_IRQ_NUM(uart)]();
+}
+
+void uart_tx_wait_blocking(uart_inst_t* uart)
+{
+}
+
+std::vector<uint8_t> host_uart_take_tx(uart_inst_t* uart)
+{
+	uart->tx_baud.clear();
+	return std::exchange(uart->tx, {});
+}
+
+std::vector<uint8_t> host_uart_take_tx(uart_inst_t* uart, uint baud)
+{
+	std::vector<uint8_t> tx;
+	for (size_t i = 0; i < uart->tx.size(); i++)
+		if (uart->tx_baud[i] == baud)
+			tx.push_back(uart->tx[i]);
+	uart->tx.clear();
+	uart->tx_baud.clear();
+	return tx;
+}
+
+// ---- PIO -------------------------------------------------------------------
+
+static pio_hw_t pio_insts[2] = {{.fdebug = {0}}, {.fdebug = {1}}};
+pio_hw_t* const pio0 = &pio_insts[0];
+pio_hw_t* const pio1 = &pio_insts[1];
+
+// Timing model of a state machine: each word written to its TX FIFO takes
+// cycles_per_word PIO cycles to shift out, one after another.
+struct PioSm
+{
+	float    clkdiv = 1;
+	uint     cycles_per_word;
+	uint64_t shift_done_ns;  // When the last word it was given is out
+	bool     txstall = true;  // Stalled since TXSTALL was cleared, before now
+};
+static std::array<std::array<PioSm, 4>, 2> pio_sms;
+
+static bool pio_stalled(const PioSm& model)
+{
+	return model.shift_done_ns <= now_us * 1000;
+}
+
+host_pio_fdebug::operator uint32_t() const
+{
+	uint32_t txstall = 0;
+	for (uint sm = 0; sm < 4; sm++)
+		if (pio_sms[index][sm].txstall || pio_stalled(pio_sms[index][sm]))
+			txstall |= 1u << (PIO_FDEBUG_TXSTALL_LSB + sm);
+	return txstall;
+}
+
+host_pio_fdebug& host_pio_fdebug::operator=(uint32_t clear)
+{
+	for (uint sm = 0; sm < 4; sm++)
+		if (clear & (1u << (PIO_FDEBUG_TXSTALL_LSB + sm)))
+			pio_sms[index][sm].txstall = false;
+	return *this;
+}
+
+static std::optional<uint64_t> pio_fifo_push(uintptr_t dst, uint words)
+{
+	for (uint p = 0; p < std::size(pio_insts); p++)
+	{
+		for (uint sm = 0; sm < 4; sm++)
+		{
+			if (dst != (uintptr_t)&pio_insts[p].txf[sm])
+				continue;
+
+			PioSm& model = pio_sms[p][sm];
+			// It's been waiting on the FIFO since the last word went out
+			if (model.shift_done_ns < now_us * 1000)
+				model.txstall = true;
+			double word_ns = model.cycles_per_word * model.clkdiv * 1e9 / clock_get_hz(clk_sys);
+			uint64_t start_ns = std::max(now_us * 1000, model.shift_done_ns);
+			model.shift_done_ns = start_ns + uint64_t(words * word_ns);
+			// DMA can stay four words ahead, the depth of the FIFO
+			return start_ns + uint64_t((words > 4 ? words - 4 : 0) * word_ns);
+		}
+	}
+	return std::nullopt;
+}
+
+void pio_sm_set_clkdiv(PIO pio, uint sm, float div)
+{
+	pio_sms[pio - pio_insts][sm].clkdiv = div;
+}
+
+void host_pio_set_cycles_per_word(PIO pio, uint sm, uint cycles)
+{
+	pio_sms[pio - pio_insts][sm].cycles_per_word = cycles;
+}
+static uint32_t pio_exec_count = 0;
+static std::array<uint, 2> pio_claimed_sms;
+
+// pps_capture.pio's state machines, counting clk_sys cycles
+struct PioCaptureSm
+{
+	enum Kind { none, edge, phase } kind = none;
+	uint     pin;
+	uint     cycles_per_us;
+	uint64_t from_cycle;  // Edge: restarted then; phase: started then
+	uint32_t slips;       // Phase: cycles lost to forced instructions
+	std::deque<uint32_t> rx;
+};
+static std::array<std::array<PioCaptureSm, 4>, 2> pio_capture_sms;
+
+static uint64_t cycles_per_us()
+{
+	return clock_get_hz(clk_sys) / 1'000'000;
+}
+
+// The virtual clock only has whole microseconds, so everything happens on one
+static uint64_t now_cycle()
+{
+	return now_us * cycles_per_us();
+}
+
+static uint32_t pio_capture_x(const PioCaptureSm& model)
+{
+	if (model.kind == PioCaptureSm::phase)
+	{	// Counts down from cycles_per_us - 2 to all ones
+		uint32_t cycle = (now_cycle() - model.from_cycle - model.slips) % model.cycles_per_us;
+		return model.cycles_per_us - 2 - cycle;
+	}
+	// The first cycle the pin is high, then a few to get through the synchroniser
+	const std::optional<uint64_t>& rise_ns = gpio_rise_ns[model.pin];
+	if (!rise_ns)
+		return ~0u;
+	uint64_t rise_cycle = (*rise_ns * cycles_per_us() + 999) / 1000;
+	if (rise_cycle < model.from_cycle || now_cycle() < rise_cycle + pps_edge_sync_cycles)
+		return ~0u;
+	return ~0u - uint32_t(now_cycle() - rise_cycle - pps_edge_sync_cycles);
+}
+
+void host_pio_model_pps_edge(PIO pio, uint sm, uint pin)
+{
+	pio_capture_sms[pio - pio_insts][sm] = {.kind = PioCaptureSm::edge, .pin = pin, .from_cycle = now_cycle()};
+}
+
+void host_pio_model_pps_phase(PIO pio, uint sm, uint cycles_per_us)
+{
+	// Nothing lines it up with the timer, so it starts some way into a microsecond
+	pio_capture_sms[pio - pio_insts][sm] = {.kind = PioCaptureSm::phase, .cycles_per_us = cycles_per_us, .from_cycle = now_cycle() - 37};
+}
+
+uint pio_add_program(PIO pio, const pio_program_t* program)
+{
+	return 0;
+}
+
+int pio_claim_unused_sm(PIO pio, bool required)
+{
+	uint& claimed = pio_claimed_sms[pio - pio_insts];
+	return claimed < 4 ? claimed++ : -1;
+}
+
+void pio_sm_exec(PIO pio, uint sm, uint instr)
+{
+	PioCaptureSm& model = pio_capture_sms[pio - pio_insts][sm];
+	if (model.kind == PioCaptureSm::none)
+		pio_exec_count++;
+	else if (instr == pio_encode_in(pio_x, 32))
+		model.rx.push_back(pio_capture_x(model));
+	else if (model.kind == PioCaptureSm::edge)
+		model.from_cycle = now_cycle();
+	// The forced instruction takes one of the loop's cycles
+	if (model.kind == PioCaptureSm::phase)
+		model.slips++;
+}
+
+uint32_t pio_sm_get(PIO pio, uint sm)
+{
+	std::deque<uint32_t>& rx = pio_capture_sms[pio - pio_insts][sm].rx;
+	if (rx.empty())
+		return 0;
+	uint32_t word = rx.front();
+	rx.pop_front();
+	return word;
+}
+
+uint32_t pio_sm_get_blocking(PIO pio, uint sm)
+{
+	return pio_sm_get(pio, sm);
+}
+
+uint pio_get_dreq(PIO pio, uint sm, bool is_tx)
+{
+	return sm;
+}
+
+void pio_gpio_init(PIO pio, uint pin) {}
+
+uint32_t host_pio_exec_count()
+{
+	return pio_exec_count;
+}
+
+// ---- Flash -----------------------------------------------------------------
+
+uint8_t host_flash[PICO_FLASH_SIZE_BYTES];
+uint32_t* __flash_binary_end = nullptr;
+
+// Flash leaves the factory erased
+static const bool flash_blank = (std::memset(host_flash, 0xff, sizeof(host_flash)), true);
+
+// Bytes the flash still has power to change, or -1 for as many as it likes
+static int64_t flash_power_left = -1;
+static bool    flash_power_cut  = false;
+
+static bool flash_set(uint32_t flash_offs, uint8_t value)
+{
+	if (host_flash[flash_offs] == value)
+		return true;  // Cutting before or after this makes no difference
+	if (flash_power_left == 0)
+		flash_power_cut = true;
+	if (flash_power_cut)
+		return false;
+	if (flash_power_left > 0)
+		flash_power_left--;
+	host_flash[flash_offs] = value;
+	return true;
+}
+
+void host_flash_cut_power_after(int64_t bytes)
+{
+	flash_power_left = bytes;
+	flash_power_cut  = false;
+}
+
+bool host_flash_power_was_cut()
+{
+	return flash_power_cut;
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count)
+{
+	for (size_t i = 0; i < count && flash_set(flash_offs + i, 0xff); i++)
+		;
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t* data, size_t count)
+{
+	for (size_t i = 0; i < count && flash_set(flash_offs + i, host_flash[flash_offs + i] & data[i]); i++)
+		;
+}
+
+void flash_get_unique_id(uint8_t* id_out)
+{
+	static constexpr uint8_t id[FLASH_UNIQUE_ID_SIZE_BYTES] = {0xE6, 0x61, 0x38, 0x52, 0xD3, 0x4A, 0x29, 0x2F};
+	std::memcpy(id_out, id, sizeof(id));
+}
@@ -0,0 +1,39 @@
+#pragma once
+// Controls for the host stand-ins of the pico-sdk.  These let a harness
+// drive virtual time and inject the hardware events the firmware reacts to.
+#include "pico/stdlib.h"
+#include <span>
+#include <vector>
+
+// Virtual clock.  Advancing runs any alarms that come due, in order.
+void     host_set_time_us(uint64_t us);
+void     host_advance_us(uint64_t us);
+
+// Queue bytes on a UART's receive FIFO and run its IRQ handler
+void     host_uart_rx(uart_inst_t* uart, std::span<const uint8_t> data);
+// Everything written to a UART since the last call
+std::vector<uint8_t> host_uart_take_tx(uart_inst_t* uart);
+// ...only what went out at baud; the rest would be garbage at the other end
+std::vector<uint8_t> host_uart_take_tx(uart_inst_t* uart, uint baud);
+// The baud rate it was last set to
+uint     host_uart_baud(uart_inst_t* uart);
+
+// Fire a GPIO interrupt, e.g. the GPS PPS edge
+void     host_gpio_irq(uint gpio, uint32_t event_mask);
+// Say when a pin went high, to the nanosecond, for PIO to have seen.  The
+// interrupt for it is separate, since it can come a while later.
+void     host_gpio_rise_ns(uint gpio, uint64_t at_ns);
+
+// The words most recently pushed to a PIO TX FIFO by DMA
+std::span<const uint32_t> host_dma_last_transfer(uint channel);
+// Number of PIO instructions forced with pio_sm_exec (display latches), not
+// counting those to the PPS capture models
+uint32_t host_pio_exec_count();
+
+// Cut the flash's power once it's programmed or erased this many more bytes,
+// which it does in address order.  Only bytes that change count, since a cut
+// either side of one that doesn't leaves the same thing.  Nothing changes
+// after the cut until this is called again; -1 means never.
+void     host_flash_cut_power_after(int64_t bytes);
+// Whether that happened
+bool     host_flash_power_was_cut();
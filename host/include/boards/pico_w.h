@@ -0,0 +1,3 @@
+#pragma once
+// Host stand-in for boards/pico_w.h
+#define PICO_FLASH_SIZE_BYTES (2 * 1024 * 1024)
@@ -0,0 +1,13 @@
+#pragma once
+// Host stand-in for hardware/clocks.h
+#include "pico/types.h"
+
+enum clock_index
+{
+	clk_sys = 5,
+};
+
+static inline uint32_t clock_get_hz(clock_index clk_index)
+{
+	return 125'000'000;
+}
@@ -0,0 +1,48 @@
+#pragma once
+// Host stand-in for hardware/dma.h.  A triggered memory-to-FIFO transfer
+// copies straight into the destination, as if the DREQ were always ready.
+// Transfers reading from a UART wait for host_uart_rx().
+#include "pico/types.h"
+
+enum dma_channel_transfer_size
+{
+	DMA_SIZE_8  = 0,
+	DMA_SIZE_16 = 1,
+	DMA_SIZE_32 = 2,
+};
+
+struct dma_channel_config
+{
+	uint dreq;
+	dma_channel_transfer_size size;
+	bool read_increment;
+	bool write_increment;
+	bool ring_write;
+	uint ring_size_bits;
+};
+
+// Addresses are pointer sized here, rather than 32-bit registers
+struct dma_channel_hw_t
+{
+	volatile uintptr_t read_addr;
+	volatile uintptr_t write_addr;
+	volatile uint32_t  transfer_count;
+};
+
+int  dma_claim_unused_channel(bool required);
+dma_channel_config dma_channel_get_default_config(uint channel);
+void channel_config_set_dreq(dma_channel_config* c, uint dreq);
+void channel_config_set_transfer_data_size(dma_channel_config* c, dma_channel_transfer_size size);
+void channel_config_set_read_increment(dma_channel_config* c, bool incr);
+void channel_config_set_write_increment(dma_channel_config* c, bool incr);
+void channel_config_set_ring(dma_channel_config* c, bool write, uint size_bits);
+void dma_channel_configure(uint channel, const dma_channel_config* config, volatile void* write_addr,
+	const volatile void* read_addr, uint transfer_count, bool trigger);
+void dma_channel_set_read_addr(uint channel, const volatile void* read_addr, bool trigger);
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger);
+void dma_channel_abort(uint channel);
+bool dma_channel_is_busy(uint channel);
+// Completion interrupts, on DMA_IRQ_0
+void dma_channel_set_irq0_enabled(uint channel, bool enabled);
+void dma_channel_acknowledge_irq0(uint channel);
+dma_channel_hw_t* dma_channel_hw_addr(uint channel);
@@ -0,0 +1,16 @@
+#pragma once
+// Host stand-in for hardware/flash.h.  Flash is a RAM array with NOR
+// semantics: erase sets bits to one, program can only clear them.
+#include "pico/types.h"
+#include "boards/pico_w.h"
+
+#define FLASH_PAGE_SIZE   (1u << 8)
+#define FLASH_SECTOR_SIZE (1u << 12)
+#define FLASH_UNIQUE_ID_SIZE_BYTES 8
+
+extern uint8_t host_flash[PICO_FLASH_SIZE_BYTES];
+#define XIP_BASE (reinterpret_cast<uintptr_t>(host_flash))
+
+void flash_range_erase(uint32_t flash_offs, size_t count);
+void flash_range_program(uint32_t flash_offs, const uint8_t* data, size_t count);
+void flash_get_unique_id(uint8_t* id_out);
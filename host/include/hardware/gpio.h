@@ -0,0 +1,27 @@
+#pragma once
+// Host stand-in for hardware/gpio.h
+#include "pico/types.h"
+
+enum gpio_function
+{
+	GPIO_FUNC_SIO  = 5,
+	GPIO_FUNC_UART = 2,
+	GPIO_FUNC_PIO0 = 6,
+};
+
+enum gpio_irq_level
+{
+	GPIO_IRQ_LEVEL_LOW  = 0x1u,
+	GPIO_IRQ_LEVEL_HIGH = 0x2u,
+	GPIO_IRQ_EDGE_FALL  = 0x4u,
+	GPIO_IRQ_EDGE_RISE  = 0x8u,
+};
+
+typedef void (*gpio_irq_callback_t)(uint gpio, uint32_t event_mask);
+
+void gpio_init(uint gpio);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_put(uint gpio, bool value);
+void gpio_set_function(uint gpio, gpio_function fn);
+void gpio_set_irq_callback(gpio_irq_callback_t callback);
+void gpio_set_irq_enabled(uint gpio, uint32_t event_mask, bool enabled);
@@ -0,0 +1,2 @@
+#pragma once
+// Host stand-in for hardware/i2c.h (unused)
@@ -0,0 +1,17 @@
+#pragma once
+// Host stand-in for hardware/irq.h
+#include "pico/types.h"
+
+typedef void (*irq_handler_t)();
+
+enum irq_num_rp2040
+{
+	DMA_IRQ_0    = 11,
+	IO_IRQ_BANK0 = 13,
+	UART0_IRQ    = 20,
+	UART1_IRQ    = 21,
+	NUM_IRQS     = 32,
+};
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+void irq_set_enabled(uint num, bool enabled);
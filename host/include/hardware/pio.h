@@ -0,0 +1,66 @@
+#pragma once
+// Host stand-in for hardware/pio.h
+#include "pico/types.h"
+
+#define PIO_FDEBUG_TXSTALL_LSB 24
+
+// FDEBUG, with TXSTALL worked out from the timing model in hal.cpp.  As on
+// the chip, it's set whenever a state machine stalls on an empty FIFO, and
+// writing 1 clears it, though only until the next cycle if it's still stalled.
+struct host_pio_fdebug
+{
+	uint index;
+	operator uint32_t() const;
+	host_pio_fdebug& operator=(uint32_t clear);
+};
+
+struct pio_hw_t
+{
+	host_pio_fdebug   fdebug;
+	volatile uint32_t txf[4];
+};
+typedef pio_hw_t* PIO;
+
+extern pio_hw_t* const pio0;
+extern pio_hw_t* const pio1;
+
+struct pio_program_t
+{
+	const uint16_t* instructions;
+	uint8_t length;
+	int8_t  origin;
+};
+
+
+enum pio_src_dest
+{
+	pio_x = 1,
+};
+
+uint pio_add_program(PIO pio, const pio_program_t* program);
+int  pio_claim_unused_sm(PIO pio, bool required);
+void pio_sm_exec(PIO pio, uint sm, uint instr);
+// Only the state machines modelled below have anything to read
+uint32_t pio_sm_get(PIO pio, uint sm);
+uint32_t pio_sm_get_blocking(PIO pio, uint sm);
+uint pio_get_dreq(PIO pio, uint sm, bool is_tx);
+void pio_gpio_init(PIO pio, uint pin);
+void pio_sm_set_clkdiv(PIO pio, uint sm, float div);
+
+// Timing model: how many PIO cycles the loaded program takes per FIFO word
+void host_pio_set_cycles_per_word(PIO pio, uint sm, uint cycles);
+// Models of pps_capture.pio, at clk_sys: counting cycles since a rising edge
+// on pin, and counting round cycles_per_us from when it starts.  Both answer
+// "in x, 32" with X, and the edge counter restarts on any other instruction.
+void host_pio_model_pps_edge(PIO pio, uint sm, uint pin);
+void host_pio_model_pps_phase(PIO pio, uint sm, uint cycles_per_us);
+
+static inline uint pio_encode_jmp(uint addr)
+{
+	return addr;
+}
+
+static inline uint pio_encode_in(pio_src_dest src, uint count)
+{
+	return 0x4000 | (src << 5) | (count & 31);
+}
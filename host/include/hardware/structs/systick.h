@@ -0,0 +1,14 @@
+#pragma once
+// Host stand-in for hardware/structs/systick.h.  The counter follows the
+// virtual clock at 125MHz, counting down like the real one.
+#include "pico/types.h"
+
+struct systick_hw_t
+{
+	volatile uint32_t csr;
+	volatile uint32_t rvr;
+	volatile uint32_t cvr;
+	volatile uint32_t calib;
+};
+
+extern systick_hw_t* const systick_hw;
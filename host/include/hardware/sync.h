@@ -0,0 +1,6 @@
+#pragma once
+// Host stand-in for hardware/sync.h
+#include "pico/types.h"
+
+uint32_t save_and_disable_interrupts();
+void restore_interrupts(uint32_t status);
@@ -0,0 +1,40 @@
+#pragma once
+// Host stand-in for hardware/uart.h.  Received bytes are queued by the
+// host harness with host_uart_rx(), which hands them to a DMA channel
+// reading the data register if there is one, or else runs the IRQ.
+#include "pico/types.h"
+#include "hardware/irq.h"
+
+struct uart_inst_t;
+
+struct uart_hw_t
+{
+	volatile uint32_t dr;
+};
+
+extern uart_inst_t* const uart0;
+extern uart_inst_t* const uart1;
+
+enum uart_parity_t
+{
+	UART_PARITY_NONE,
+	UART_PARITY_EVEN,
+	UART_PARITY_ODD,
+};
+
+uint uart_get_index(uart_inst_t* uart);
+uart_hw_t* uart_get_hw(uart_inst_t* uart);
+uint uart_get_dreq(uart_inst_t* uart, bool is_tx);
+#define UART_IRQ_NUM(uart) (uart_get_index(uart) ? UART1_IRQ : UART0_IRQ)
+
+uint uart_init(uart_inst_t* uart, uint baudrate);
+uint uart_set_baudrate(uart_inst_t* uart, uint baudrate);
+void uart_set_hw_flow(uart_inst_t* uart, bool cts, bool rts);
+void uart_set_format(uart_inst_t* uart, uint data_bits, uint stop_bits, uart_parity_t parity);
+void uart_set_irq_enables(uart_inst_t* uart, bool rx_has_data, bool tx_needs_data);
+bool uart_is_readable(uart_inst_t* uart);
+bool uart_is_writable(uart_inst_t* uart);
+void uart_putc_raw(uart_inst_t* uart, char c);
+char uart_getc(uart_inst_t* uart);
+void uart_write_blocking(uart_inst_t* uart, const uint8_t* src, size_t len);
+void uart_tx_wait_blocking(uart_inst_t* uart);
@@ -0,0 +1,12 @@
+#pragma once
+// Host stand-in for pico/flash.h.  Nothing runs from flash, so there's
+// nothing to make safe.
+#include "pico/types.h"
+
+#define PICO_OK 0
+
+static inline int flash_safe_execute(void (*func)(void*), void* param, uint32_t enter_exit_timeout_ms)
+{
+	func(param);
+	return PICO_OK;
+}
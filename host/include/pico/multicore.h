@@ -0,0 +1,12 @@
+#pragma once
+// Host stand-in for pico/multicore.h.  There's no second core, so core 1
+// is never started.
+#include "pico/types.h"
+
+static inline void multicore_launch_core1(void (*entry)())
+{
+}
+
+static inline void multicore_lockout_victim_init()
+{
+}
@@ -0,0 +1,27 @@
+#pragma once
+// Host stand-in for pico/stdlib.h
+#include <stdio.h>
+#include "pico/types.h"
+#include "pico/time.h"
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/uart.h"
+
+static inline bool stdio_init_all()
+{
+	return true;
+}
+
+// Moves the virtual clock on a microsecond, so spinning on it ends
+void tight_loop_contents();
+
+// There's only the one core
+static inline uint get_core_num()
+{
+	return 0;
+}
+
+static inline int putchar_raw(int c)
+{
+	return putchar(c);
+}
@@ -0,0 +1,16 @@
+#pragma once
+// Host stand-in for pico/time.h.  Time is virtual and only moves when the
+// host harness advances it (see host/hal.hpp).
+#include "pico/types.h"
+
+typedef int32_t alarm_id_t;
+typedef int64_t (*alarm_callback_t)(alarm_id_t id, void* user_data);
+
+absolute_time_t get_absolute_time();
+uint64_t time_us_64();
+uint32_t time_us_32();
+void sleep_ms(uint32_t ms);
+void sleep_us(uint64_t us);
+
+void alarm_pool_init_default();
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback, void* user_data, bool fire_if_past);
@@ -0,0 +1,12 @@
+#pragma once
+// Host stand-in for pico/types.h
+#include <cstdint>
+#include <cstddef>
+
+typedef unsigned int uint;
+typedef uint64_t     absolute_time_t;
+
+static inline uint64_t to_us_since_boot(absolute_time_t t)
+{
+	return t;
+}
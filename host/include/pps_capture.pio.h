@@ -0,0 +1,28 @@
+#pragma once
+// Host stand-in for the header pico_generate_pio_header() makes from pps_capture.pio
+#include "hardware/pio.h"
+
+#define pps_edge_offset_start 0u
+#define pps_edge_sync_cycles 3
+
+static const pio_program_t pps_edge_program = {
+	.instructions = nullptr,
+	.length       = 4,
+	.origin       = -1,
+};
+
+static const pio_program_t pps_phase_program = {
+	.instructions = nullptr,
+	.length       = 3,
+	.origin       = -1,
+};
+
+static inline void pps_edge_program_init(PIO pio, uint sm, uint offset, uint pin)
+{
+	host_pio_model_pps_edge(pio, sm, pin);
+}
+
+static inline void pps_phase_program_init(PIO pio, uint sm, uint offset, uint cycles_per_us)
+{
+	host_pio_model_pps_phase(pio, sm, cycles_per_us);
+}
@@ -0,0 +1,22 @@
+#pragma once
+// Host stand-in for the header pico_generate_pio_header() makes from tlc5952.pio
+#include "hardware/pio.h"
+#include "hardware/clocks.h"
+
+#define tlc5952_write_offset_latch 6u
+#define tlc5952_write_cycles_per_word 54
+
+static const pio_program_t tlc5952_write_program = {
+	.instructions = nullptr,
+	.length       = 8,
+	.origin       = -1,
+};
+
+static inline void tlc5952_write_program_init(PIO pio, uint sm, uint offset, uint tx_pin, uint clk_pin, uint latch_pin, uint bit_rate)
+{
+	pio_gpio_init(pio, tx_pin);
+	pio_gpio_init(pio, clk_pin);
+	pio_gpio_init(pio, latch_pin);
+	host_pio_set_cycles_per_word(pio, sm, tlc5952_write_cycles_per_word);
+	pio_sm_set_clkdiv(pio, sm, clock_get_hz(clk_sys) / (2.0 * bit_rate));
+}
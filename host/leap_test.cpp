@@ -0,0 +1,225 @@
+// A leap second end to end.  The receiver announces it, its PPS edges and
+// time messages go through gps.cpp, and do_every_ms's frames are read back
+// off the display DMA, so what's checked is the digits themselves.
+#include "hal.hpp"
+#include "config.hpp"
+#include "display.hpp"
+#include "gps_sim.hpp"
+#include "timing.hpp"
+#include "test.hpp"
+#include <algorithm>
+#include <string>
+
+extern Config config;
+int64_t do_every_ms(alarm_id_t id, void *user_data);
+
+using namespace std::chrono;
+
+static constexpr uint display_dma_channel = 1;
+
+// Segments lit for each digit, decimal point left out
+static const uint8_t digit_segments[10] = {0xEE, 0x82, 0xDC, 0xD6, 0xB2, 0x76, 0x7E, 0xC2, 0xFE, 0xF6};
+
+// "YYYYMMDD HHMMSS.mmm" from the last frame sent
+static std::string shown()
+{
+	auto words = host_dma_last_transfer(display_dma_channel);
+	auto onoff = words.subspan(words.size() - 6);
+	std::string text;
+	for (int d = 1; d < 18; d++)
+	{
+		if (d == 9)
+			text += ' ';
+		if (d == 15)
+			text += '.';
+		uint8_t segments = (onoff[d / 3] >> ((d % 3) * 8)) & 0xFE;
+		const uint8_t* digit = std::find(std::begin(digit_segments), std::end(digit_segments), segments);
+		text += digit != std::end(digit_segments) ? char('0' + (digit - digit_segments)) : '?';
+	}
+	return text;
+}
+
+// The same for UTC t, with 23:59:60 for the second before t if second_60
+static std::string text(Time_us t, bool second_60 = false)
+{
+	Time_Parts parts = time_split(second_60 ? t - seconds(1) : t);
+	char buf[24];
+	snprintf(buf, sizeof(buf), "%04d%02d%02d %02d%02d%02d.%03d", parts.year, parts.month, parts.day,
+		parts.hour, parts.minute, second_60 ? 60 : parts.second, parts.millisecond);
+	return buf;
+}
+
+// Milliseconds since 1970 from the text above, counting the change at
+// leap_at, so with +1 it's 23:59:60 and not 00:00:00 that has leap_at's
+static int64_t elapsed_ms(const std::string& text, Time_us leap_at, int change)
+{
+	unsigned y, mo, d, h, mi, s, ms;
+	if (sscanf(text.c_str(), "%4u%2u%2u %2u%2u%2u.%3u", &y, &mo, &d, &h, &mi, &s, &ms) != 7)
+		return -1;
+	Time_us t = Time_us(sys_days{year(y) / month(mo) / day(d)}) + hours(h) + minutes(mi) + seconds(s);
+	if (t >= leap_at && s < 60)
+		t += seconds(change);
+	return duration_cast<milliseconds>(t.time_since_epoch()).count() + ms;
+}
+
+// The receiver: a PPS edge a second, each labelled by the NAV-TIMEUTC that
+// follows it 50ms later
+struct Receiver
+{
+	Pps_Source pps = {.hw_start_us = 10'000'000};
+	int64_t    n   = 0;
+
+	// Advance rather than set the time, so frames finish shifting out
+	static void to(uint64_t hw_us)
+	{
+		host_advance_us(hw_us - time_us_64());
+	}
+
+	// One labelled second, with a frame every frame_every_ms, each handed to
+	// check along with the time into the second
+	template <typename Check>
+	void second(Time_us utc, bool second_60, int frame_every_ms, Check&& check)
+	{
+		bool labelled = false;
+		auto label = [&] {
+			to(pps.hw_at(n) + 50'000);
+			send_nav_timeutc(utc, second_60);
+			labelled = true;
+		};
+		to(pps.hw_at(n));
+		gps_on_pps();
+		for (int ms = 0; ms < 1000; ms += frame_every_ms)
+		{
+			if (ms >= 50 && !labelled)
+				label();
+			to(pps.hw_at(n) + ms * 1000);
+			do_every_ms(0, nullptr);
+			check(ms, shown());
+		}
+		if (!labelled)
+			label();
+		n++;
+	}
+
+	void second(Time_us utc, bool second_60 = false)
+	{
+		second(utc, second_60, 1000, [](int, const std::string&) {});
+	}
+};
+
+// Shown as 23:59:58, 23:59:59, 23:59:60, 00:00:00, every millisecond of it,
+// and never going back
+static void test_step(Receiver& receiver, Time_us midnight)
+{
+	gps_set_leap_smear(false);
+	Time_us t = midnight - seconds(30);
+	receiver.second(t);
+	send_nav_timels(+1, 29);
+	t += seconds(1);
+	for (; t < midnight - seconds(3); t += seconds(1))
+		receiver.second(t);
+
+	Clock_State clock = gps_get_clock_state();
+	CHECK(clock.locked && clock.leap.armed() && !clock.leap.smear && clock.leap.at == midnight);
+
+	int64_t last_ms = -1;
+	int wrong = 0, shown_60 = 0;
+	auto run = [&](Time_us utc, bool second_60) {
+		receiver.second(utc, second_60, 1, [&](int ms, const std::string& now) {
+			// The frame is for the millisecond ahead, which can be the next label's
+			std::string want = ms < 999                     ? text(utc + milliseconds(ms + 1), second_60)
+			                 : second_60                    ? text(utc)
+			                 : utc + seconds(1) == midnight ? text(midnight, true)
+			                 :                                text(utc + seconds(1));
+			if (now != want && wrong++ < 5)
+				CHECK(false, "%s +%dms: shows %s", want.c_str(), ms, now.c_str());
+			if (now.substr(9, 6) == "235960")
+				shown_60++;
+			int64_t now_ms = elapsed_ms(now, midnight, +1);
+			CHECK(now_ms == last_ms + 1 || last_ms < 0, "%s after %lld", now.c_str(), (long long)last_ms);
+			last_ms = now_ms;
+		});
+	};
+	for (; t < midnight; t += seconds(1))
+		run(t, false);
+	run(midnight, true);
+	for (; t < midnight + seconds(3); t += seconds(1))
+		run(t, false);
+
+	CHECK(wrong == 0, "%d frames wrong", wrong);
+	CHECK(shown_60 == 1000, "23:59:60 shown %d times", shown_60);
+	clock = gps_get_clock_state();
+	CHECK(clock.locked && !clock.leap.armed(), "locked %d, armed %d", clock.locked, clock.leap.armed());
+}
+
+// Over the 24 hours around midnight the clock falls behind by one second,
+// evenly, without ever showing 23:59:60 or going backwards.  It's back on
+// UTC for the second after, and the servo with it.
+static void test_smear(Receiver& receiver, Time_us t, Time_us midnight)
+{
+	gps_set_leap_smear(true);
+	const auto half_window = Leap_Event::smear_window / 2;
+	receiver.second(t);
+	send_nav_timels(+1, int32_t(duration_cast<seconds>(midnight - t).count()) - 1);
+	t += seconds(1);
+
+	Clock_State clock = gps_get_clock_state();
+	CHECK(clock.leap.armed() && clock.leap.smear && clock.leap.at == midnight);
+
+	// UTC's window is a second longer than the servo's
+	const int64_t window_ms = duration_cast<milliseconds>(Leap_Event::smear_window).count() + 1000;
+	const int64_t start_ms  = duration_cast<milliseconds>((midnight - half_window).time_since_epoch()).count();
+	int64_t last_ms = 0, most_behind_ms = 0;
+	int wrong = 0, shown_60 = 0;
+	auto run = [&](Time_us utc, bool second_60) {
+		receiver.second(utc, second_60, 250, [&](int ms, const std::string& now) {
+			// Smeared time has no 23:59:60, so it's counted without one
+			int64_t now_ms  = elapsed_ms(now, midnight, 0);
+			int64_t real_ms = elapsed_ms(text(utc, second_60), midnight, +1) + ms + 1;
+			// UTC runs on by a second while the smeared time takes the whole window
+			int64_t want_behind_us = std::clamp(real_ms - start_ms, int64_t(0), window_ms) * 1'000'000 / window_ms;
+			int64_t behind_ms = real_ms - now_ms;
+			if (std::abs(behind_ms * 1000 - want_behind_us) > 1000 && wrong++ < 5)
+				CHECK(false, "%s +%dms: shows %s, %lldms behind, not %lldus", text(utc, second_60).c_str(), ms,
+					now.c_str(), (long long)behind_ms, (long long)want_behind_us);
+			if (now.substr(9, 6) == "235960")
+				shown_60++;
+			CHECK(now_ms >= last_ms, "%s went back", now.c_str());
+			last_ms = now_ms;
+			most_behind_ms = std::max(most_behind_ms, behind_ms);
+		});
+	};
+	for (; t < midnight; t += seconds(1))
+		run(t, false);
+	run(midnight, true);
+	for (; t < midnight + half_window + seconds(10); t += seconds(1))
+		run(t, false);
+
+	CHECK(wrong == 0, "%d frames wrong", wrong);
+	CHECK(shown_60 == 0, "23:59:60 shown %d times", shown_60);
+	CHECK(most_behind_ms >= 999, "only ever %lldms behind", (long long)most_behind_ms);
+	printf("leap: smeared time at most %lldms behind\n", (long long)most_behind_ms);
+	clock = gps_get_clock_state();
+	CHECK(clock.locked && !clock.leap.armed(), "locked %d, armed %d", clock.locked, clock.leap.armed());
+}
+
+int main()
+{
+	host_set_time_us(10'000'000);
+	timing_init();
+	gps_init_io(uart1, 9600, 5, 4);
+	disp_init(pio0, 11, 10, 9);
+	config.brightness = 64;
+
+	// One receiver throughout: a second leap second has to be taken up after
+	// the first is done with
+	Receiver receiver;
+	Time_us first = Time_us(sys_days{year{2016} / 12 / 31}) + days(1);
+	test_step(receiver, first);
+	Time_us next = first + days(1);
+	Time_us t = first + seconds(3);
+	for (; t < next - Leap_Event::smear_window / 2 - seconds(10); t += seconds(1))
+		receiver.second(t);
+	test_smear(receiver, t, next);
+	return test_result("leap_test");
+}
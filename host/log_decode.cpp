@@ -0,0 +1,97 @@
+// Turns a debug UART capture from a LOG_BINARY build back into text.  Log
+// frames are decoded with the firmware's own format table; anything else,
+// like the timing tables, is passed through as it is.
+//   log_decode [capture]    reads stdin if no file is given, e.g. a serial port
+#include "log.hpp"
+#include <cstdio>
+#include <cstring>
+
+// Whether frame[0..size) is a whole, valid frame.  Returns its length, or 0
+// if more bytes are needed, or -1 if it isn't a frame.
+static int parse(const uint8_t* frame, uint32_t size, Log_Record& record)
+{
+	constexpr uint32_t header = 1 + 2 + 1 + 8;
+	if (size < header)
+		return 0;
+	uint16_t id       = frame[1] | frame[2] << 8;
+	uint8_t  num_args = frame[3];
+	if (id >= (int)Log_Id::COUNT || num_args > Log_Record::max_args)
+		return -1;
+	uint32_t length = header + 4 * num_args + 1;
+	if (size < length)
+		return 0;
+
+	uint8_t sum = 0;
+	for (uint32_t i = 1; i < length - 1; i++)
+		sum += frame[i];
+	if (sum != frame[length - 1])
+		return -1;
+
+	record = {.id = Log_Id(id), .num_args = num_args, .args = {}};
+	std::memcpy(&record.time_us, &frame[4], 8);
+	for (uint32_t i = 0; i < num_args; i++)
+		std::memcpy(&record.args[i], &frame[header + 4 * i], 4);
+	return length;
+}
+
+int main(int argc, char** argv)
+{
+	FILE* in = argc > 1 ? fopen(argv[1], "rb") : stdin;
+	if (!in)
+	{
+		perror(argv[1]);
+		return 1;
+	}
+
+	uint8_t  frame[log_frame_max];
+	uint32_t size = 0;  // Bytes held in frame, not yet decoded or passed through
+	uint32_t frames = 0, bad = 0;
+
+	auto consume = [&](uint32_t length) {
+		size -= length;
+		std::memmove(frame, frame + length, size);
+	};
+	// Decode what's held, until it takes more bytes to tell.  A bad frame
+	// only costs its sync byte; whatever follows it is looked at again,
+	// since the real frame may start inside it.
+	auto drain = [&] {
+		while (size > 0)
+		{
+			if (frame[0] != log_frame_sync)
+			{
+				putchar(frame[0]);
+				consume(1);
+				continue;
+			}
+			Log_Record record;
+			int length = parse(frame, size, record);
+			if (length == 0)
+				break;
+			if (length > 0)
+			{
+				log_print(record);
+				frames++;
+				consume(length);
+			}
+			else
+			{
+				bad++;
+				consume(1);
+			}
+		}
+	};
+
+	int ch;
+	while ((ch = fgetc(in)) != EOF)
+	{
+		// Whatever's held is short of one frame, so there's room
+		frame[size++] = ch;
+		drain();
+		fflush(stdout);
+	}
+	// Anything still held is a frame cut off by the end of the capture
+	if (size > 0)
+		bad++;
+	fprintf(stderr, "%u log records, %u bad frames\n", frames, bad);
+	return 0;
+}
@@ -0,0 +1,121 @@
+// A replay of PPS edges from a receiver whose pulse snaps to its own 48MHz
+// clock, so each is up to ~10ns off the true second, by the qErr that
+// TIM-TP gives ahead of it.  The interrupt gets in 2-20us after the edge.
+// The clock's error at each true second is measured three ways through
+// gps.cpp: edges timestamped by the interrupt reading the timer, captured
+// by PIO to a cycle, and captured with qErr applied.  Each has to be
+// closer than the one before.
+#include "hal.hpp"
+#include "gps.hpp"
+#include "gps_sim.hpp"
+#include "pps_capture.hpp"
+#include "timing.hpp"
+#include "test.hpp"
+#include <cmath>
+#include <random>
+
+using namespace std::chrono;
+
+static constexpr uint   pps_pin      = 3;
+static constexpr double tick_ns      = 1e9 / 48e6;  // Receiver's clock
+static constexpr double drift_ppb    = 17'000;
+static const Time_us    utc_start    = sys_days{year{2025} / 3 / 1};
+static constexpr uint64_t hw_start_ns = 10'000'000'123;
+
+static std::mt19937 random_gen(7);
+
+// The receiver's quantization error for edge n: a sawtooth as its clock
+// slides past the true second
+static double qerr_ns(int64_t n)
+{
+	return std::fmod(3.1 + n * 2.3, tick_ns) - tick_ns / 2;
+}
+
+// Hardware time of edge n, which is qerr_ns(n) after the true second
+static uint64_t edge_ns(int64_t n)
+{
+	return hw_start_ns + uint64_t(std::llround(n * 1e9 * (1 + drift_ppb * 1e-9) + qerr_ns(n)));
+}
+
+static void send_tim_tp(int32_t qerr_ps)
+{
+	uint8_t payload[16] = {};
+	std::memcpy(&payload[8], &qerr_ps, 4);
+	host_uart_rx(uart1, ubx_frame(0x0D, 0x01, payload));
+	gps_poll();
+}
+
+// What the clock says at the true second of edge n, minus the truth, in ns.
+// Worked out from the model in full, since the clock's own microseconds
+// would hide everything of interest.
+static double error_ns(int64_t n)
+{
+	const Clock_Model& model = gps_get_clock_state().model;
+	double   second_ns = double(edge_ns(n)) - qerr_ns(n);
+	int64_t  whole_us  = int64_t(model.ref_hw_us) + model.phase_us
+	                   - (utc_start + seconds(n)).time_since_epoch().count();
+	double   since_us  = (second_ns - double(model.ref_hw_us) * 1000) / 1000;
+	return (double(whole_us) + since_us + (model.phase_frac + since_us * model.rate_q32) / 0x1p32) * 1000;
+}
+
+struct Errors
+{
+	double mean_ns;
+	double sd_ns;
+};
+
+// Edges [from, to), with TIM-TP before each if with_qerr, and the clock's
+// error over those after settle
+static Errors run(int64_t from, int64_t to, int64_t settle, bool with_qerr)
+{
+	std::uniform_int_distribution<uint64_t> latency_us(2, 20);
+	double sum = 0, sum_sq = 0;
+	int count = 0;
+	for (int64_t n = from; n < to; n++)
+	{
+		uint64_t edge = edge_ns(n);
+		// TIM-TP comes in the second before the edge it's for
+		host_advance_us(edge / 1000 - 500'000 - time_us_64());
+		if (with_qerr)
+			send_tim_tp(int32_t(std::lround(qerr_ns(n) * 1000)));
+
+		if (n >= from + settle)
+		{
+			double error = error_ns(n);
+			sum    += error;
+			sum_sq += error * error;
+			count++;
+		}
+
+		host_advance_us(edge / 1000 - time_us_64());
+		host_gpio_rise_ns(pps_pin, edge);
+		host_advance_us(1 + latency_us(random_gen));
+		gps_on_pps();
+		host_advance_us(50'000);
+		send_nav_timeutc(utc_start + seconds(n));
+	}
+	CHECK(gps_get_clock_state().locked);
+	double mean = sum / count;
+	return {mean, std::sqrt(sum_sq / count - mean * mean)};
+}
+
+int main()
+{
+	host_set_time_us(hw_start_ns / 1000 - 600'000);
+	timing_init();
+	gps_init_io(uart1, 115200, 5, 4);
+
+	Errors timer = run(0, 200, 100, false);
+	CHECK(pps_capture_init(pio1, pps_pin));
+	Errors captured  = run(200, 400, 100, false);
+	Errors with_qerr = run(400, 600, 100, true);
+
+	printf("pps_qerr: error at the true second %.1f+-%.1fns timer, %.1f+-%.1fns captured, %.1f+-%.1fns with qErr\n",
+		timer.mean_ns, timer.sd_ns, captured.mean_ns, captured.sd_ns, with_qerr.mean_ns, with_qerr.sd_ns);
+	CHECK(captured.sd_ns < timer.sd_ns / 10, "captured %.1fns against %.1fns by the timer", captured.sd_ns, timer.sd_ns);
+	CHECK(with_qerr.sd_ns < captured.sd_ns * 3 / 4, "%.1fns with qErr against %.1fns without", with_qerr.sd_ns, captured.sd_ns);
+	// Nothing's in the way of the edge once it's captured, so no lag either
+	CHECK(std::abs(captured.mean_ns) < 10 && std::abs(with_qerr.mean_ns) < 10, "%.1fns, %.1fns behind",
+		captured.mean_ns, with_qerr.mean_ns);
+	return test_result("pps_qerr_test");
+}
@@ -0,0 +1,174 @@
+// The PPS servo through gps.cpp: synthetic edges from crystals of known
+// drift, phase steps either side of the step threshold, an edge held up by a
+// flash operation, and the time saved last run.
+#include "hal.hpp"
+#include "gps.hpp"
+#include "gps_sim.hpp"
+#include "flash_window.hpp"
+#include "timing.hpp"
+#include "test.hpp"
+#include <cmath>
+
+using namespace std::chrono;
+
+static const Time_us utc_start = sys_days{year{2025} / 3 / 1};
+static uint64_t next_hw_start_us = 10'000'000;
+
+// UTC the clock gives at hardware time hw_us, minus the truth
+static double residual_us(const Pps_Source& pps, int64_t n)
+{
+	uint64_t hw_us = pps.hw_at(n);
+	Clock_State clock = gps_get_clock_state();
+	return double(int64_t(hw_us + clock.offset_us(hw_us))) - double((utc_start + seconds(n)).time_since_epoch().count());
+}
+
+// Run edges [from, to), checking the displayed time never jumps more than
+// max_jump_us when a message comes in.  The slew starts from the edge, so
+// the time shown moves by what it would have slewed since, a few percent
+// of the error.  Returns the first edge the clock was locked after, or -1.
+static int64_t run(Pps_Source& pps, int64_t from, int64_t to, double max_jump_us = 1)
+{
+	int64_t locked_at = -1;
+	for (int64_t n = from; n < to; n++)
+	{
+		// The time shown just before and just after the message is handled
+		uint64_t msg_hw_us = pps.hw_at(n) + 50'000;
+		Clock_State before = gps_get_clock_state();
+		pps.second(n, utc_start + seconds(n));
+		Clock_State after = gps_get_clock_state();
+		if (before.valid)
+		{
+			double jump_us = double(int64_t(after.offset_us(msg_hw_us) - before.offset_us(msg_hw_us)));
+			CHECK(std::abs(jump_us) <= max_jump_us, "jumped %.0fus at edge %lld", jump_us, (long long)n);
+		}
+		if (after.locked && locked_at < 0)
+			locked_at = n;
+	}
+	return locked_at;
+}
+
+// A fresh start with no drift estimate, far enough on that the servo steps
+static Pps_Source start(double drift_ppb)
+{
+	gps_warm_start({});
+	Pps_Source pps = {.hw_start_us = next_hw_start_us, .drift_ppb = drift_ppb};
+	next_hw_start_us += 10'000'000'000;
+	pps.second(0, utc_start);
+	CHECK(gps_get_clock_state().valid);
+	return pps;
+}
+
+// Locks within a few edges, then tracks the edges to the timer's resolution
+// and learns the crystal's error
+static void test_drift(double drift_ppb)
+{
+	Pps_Source pps = start(drift_ppb);
+	int64_t locked_at = run(pps, 1, 300);
+	CHECK(locked_at > 0 && locked_at <= 40, "%.0fppb locked at edge %lld", drift_ppb, (long long)locked_at);
+
+	double worst_us = 0;
+	for (int64_t n = 300; n < 600; n++)
+	{
+		worst_us = std::max(worst_us, std::abs(residual_us(pps, n)));
+		run(pps, n, n + 1);
+	}
+	CHECK(worst_us <= 2, "%.0fppb: %.1fus off at the edges", drift_ppb, worst_us);
+	CHECK(std::abs(gps_get_drift_ppb() - drift_ppb) <= 200, "%.0fppb estimated as %dppb", drift_ppb, gps_get_drift_ppb());
+	CHECK(gps_get_clock_state().locked);
+}
+
+// Phase errors up to the threshold are slewed out, without a jump; bigger
+// ones are stepped straight away
+static void test_step_threshold()
+{
+	Pps_Source pps = start(12'300);
+	run(pps, 1, 300);
+	CHECK(gps_get_clock_state().locked);
+
+	int64_t n = 300;
+	for (double step_us : {900.0, -900.0})
+	{
+		pps.phase_us += step_us;
+		int64_t locked_at = run(pps, n, n + 200, std::abs(step_us) * 0.05);
+		CHECK(std::abs(gps_get_clock_state().error_ns) < 2000, "%.0fus step left %dns", step_us, gps_get_clock_state().error_ns);
+		CHECK(locked_at >= 0, "%.0fus step: never relocked", step_us);
+		n += 200;
+	}
+
+	for (double step_us : {1100.0, -5000.0})
+	{
+		pps.phase_us += step_us;
+		uint64_t msg_hw_us = pps.hw_at(n) + 50'000;
+		Clock_State before = gps_get_clock_state();
+		pps.second(n, utc_start + seconds(n));
+		Clock_State after = gps_get_clock_state();
+		double jump_us = double(int64_t(after.offset_us(msg_hw_us) - before.offset_us(msg_hw_us)));
+		CHECK(std::abs(jump_us + step_us) <= 2, "%.0fus step moved the time %.0fus", step_us, jump_us);
+		CHECK(std::abs(after.error_ns / 1000 + step_us) <= 2, "%.0fus step measured as %dns", step_us, after.error_ns);
+		CHECK(!after.locked);
+		CHECK(std::abs(residual_us(pps, n + 1)) <= 2, "%.0fus step: %.1fus off at the next edge", step_us, residual_us(pps, n + 1));
+		// The drift estimate survives the step, so it relocks quickly
+		CHECK(run(pps, n + 1, n + 20) >= 0, "%.0fus step: not relocked", step_us);
+		n += 20;
+	}
+}
+
+static void no_flash_op(void*) {}
+
+// Interrupts are off while flash is written, so an edge then is timestamped
+// late.  The edge after a flash operation is left out, rather than slewed to.
+static void test_flash_held_edge()
+{
+	Pps_Source pps = start(12'300);
+	run(pps, 1, 300);
+	CHECK(gps_get_clock_state().locked);
+
+	flash_window_execute(no_flash_op, nullptr);
+	pps.phase_us += 600;
+	run(pps, 300, 301);
+	pps.phase_us -= 600;
+
+	double worst_us = 0;
+	for (int64_t n = 301; n < 320; n++)
+	{
+		worst_us = std::max(worst_us, std::abs(residual_us(pps, n)));
+		run(pps, n, n + 1);
+	}
+	CHECK(worst_us <= 2, "%.1fus off after a late edge", worst_us);
+	CHECK(gps_get_clock_state().locked);
+}
+
+// The time saved last run is a hint.  A fix earlier than it is turned away,
+// unless the receiver keeps counting on from there.
+static void test_warm_time_hint()
+{
+	for (auto saved : {utc_start + days(1), utc_start - days(1)})
+	{
+		gps_warm_start({.utc_us = saved.time_since_epoch().count()});
+		Pps_Source pps = {.hw_start_us = next_hw_start_us};
+		next_hw_start_us += 10'000'000'000;
+		int64_t valid_at = -1;
+		for (int64_t n = 0; n < 20 && valid_at < 0; n++)
+		{
+			pps.second(n, utc_start + seconds(n));
+			if (gps_get_clock_state().valid)
+				valid_at = n;
+		}
+		int64_t expected = saved > utc_start ? 9 : 0;
+		CHECK(valid_at == expected, "saved time %+lld days: valid from fix %lld",
+			(long long)duration_cast<days>(saved - utc_start).count(), (long long)valid_at);
+		CHECK(std::abs(residual_us(pps, valid_at + 1)) <= 2);
+	}
+}
+
+int main()
+{
+	timing_init();
+	gps_init_io(uart1, 115200, 5, 4);
+	for (double drift_ppb : {-40'000.0, 0.0, 12'300.0, 30'000.0})
+		test_drift(drift_ppb);
+	test_step_threshold();
+	test_flash_held_edge();
+	test_warm_time_hint();
+	return test_result("servo_test");
+}
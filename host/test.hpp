@@ -0,0 +1,28 @@
+#pragma once
+// Checks for the host tests.  Each test is its own executable, run by
+// ctest, and fails with a nonzero exit status if any check did.
+#include <cstdio>
+
+inline int test_failures = 0;
+
+// Carries on after a failure, so one run shows everything that's wrong.
+// Only the first few are printed, since a broken loop can fail millions.
+#define CHECK(cond, ...) \
+	do { \
+		if (!(cond) && test_failures++ < 20) \
+		{ \
+			printf("%s:%d: failed: %s", __FILE__, __LINE__, #cond); \
+			__VA_OPT__(printf("  "); printf(__VA_ARGS__);) \
+			printf("\n"); \
+		} \
+	} while (0)
+
+// Report and return main()'s exit status
+inline int test_result(const char* name)
+{
+	printf("%s: %s", name, test_failures ? "FAILED" : "passed");
+	if (test_failures)
+		printf(", %d checks failed", test_failures);
+	printf("\n");
+	return test_failures != 0;
+}
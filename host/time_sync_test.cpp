@@ -0,0 +1,34 @@
+// The clock's side of time sync: what it stamps and echoes, and what it does
+// with requests it can't or won't answer.  The client's side is the web
+// page's, and time_sync_test.js runs it against a simulated link.
+#include "time_sync.hpp"
+#include "test.hpp"
+
+static constexpr int64_t utc_start_us = 1'740'787'200'000'000;  // 2025-03-01
+
+static void test_server()
+{
+	Time_Sync_Server server;
+	uint8_t short_request[sizeof(Time_Sync_Request) - 1] = {};
+	CHECK(!server.on_request(short_request, utc_start_us));
+	CHECK(!server.pending());
+
+	// A second request replaces one that hasn't been answered
+	Time_Sync_Request first = {.sequence = 1, .client_tx = 100}, second = {.sequence = 2, .client_tx = 200};
+	CHECK(server.on_request(std::span((const uint8_t*)&first, sizeof(first)), utc_start_us));
+	CHECK(server.on_request(std::span((const uint8_t*)&second, sizeof(second)), utc_start_us + 10));
+	Time_Sync_Response response = server.respond(utc_start_us + 20, 50);
+	CHECK(response.sequence == 2 && response.client_tx == 200 && response.receive_us == utc_start_us + 10);
+	CHECK(response.transmit_us == utc_start_us + 20 && response.accuracy_ns == 50);
+
+	// Without the time, the stamps say so rather than giving 1970
+	CHECK(server.on_request(std::span((const uint8_t*)&first, sizeof(first)), 0));
+	response = server.respond(0, 50);
+	CHECK(response.receive_us == 0 && response.transmit_us == 0 && response.accuracy_ns == 0xFFFFFFFF);
+}
+
+int main()
+{
+	test_server();
+	return test_result("time_sync_test");
+}
@@ -0,0 +1,163 @@
+// The web page's side of time sync, ClockConfig.syncTime(), over a simulated
+// link to a clock that stamps requests the way time_sync.cpp does.  The
+// computer's clock is off from UTC by a known amount, and the two
+// directions take different, jittery times.  Run by ctest under node.
+'use strict';
+const fs   = require('fs');
+const path = require('path');
+const vm   = require('vm');
+
+let failures = 0;
+function check(ok, message) {
+	if (!ok) {
+		console.log('failed: ' + message);
+		failures++;
+	}
+}
+
+// ClockConfig.js is a plain script for the page, so load it as one.  Timers
+// are held rather than run, so a reply that never comes can time out at once.
+const timers  = [];
+const context = vm.createContext({
+	console:    {log: () => {}},
+	setTimeout: (fn) => timers.push(fn),
+});
+vm.runInContext(fs.readFileSync(path.join(__dirname, '../docs/js/ClockConfig.js'), 'utf8') +
+	'\nthis.ClockConfig = ClockConfig;', context);
+
+// Deterministic, so a failure can be chased
+function random(seed) {
+	return () => {
+		seed = (seed + 0x6D2B79F5) | 0;
+		let t = Math.imul(seed ^ (seed >>> 15), 1 | seed);
+		t ^= t + Math.imul(t ^ (t >>> 7), 61 | t);
+		return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+	};
+}
+
+const utcStartUs = 1740787200000000n;  // 2025-03-01
+
+class Link {
+	constructor(options) {
+		this.computerOffsetUs = options.computerOffsetUs;  // Computer's clock minus UTC
+		this.upUs      = options.upUs;                     // Fixed transit time to the clock...
+		this.downUs    = options.downUs;                   // ...and back
+		this.jitterUs  = options.jitterUs || 0;            // Mean queuing on top, each way
+		this.holdUs    = 7500;                             // From the request arriving to the reply leaving
+		this.knowsTime = options.knowsTime !== false;
+		this.dropEvery = options.dropEvery || 0;           // Lose every nth reply
+		this.random    = random(1);
+		this.utcUs     = utcStartUs;
+		this.delays    = [];                               // Each round trip, less the hold
+
+		this.config = new context.ClockConfig();
+		this.config._device  = {gatt: {connected: true}};
+		this.config._chSync  = {writeValueWithoutResponse: (buf) => this.exchange(buf)};
+		this.config._nowUs   = () => this.utcUs + BigInt(this.computerOffsetUs);
+		this.config._onGotValue = (name, value) => this.got = {name: name, value: value};
+	}
+
+	jitter() {
+		return this.jitterUs ? Math.round(-Math.log(1 - this.random()) * this.jitterUs) : 0;
+	}
+
+	// The clock's side of one round trip.  Its own time is UTC.
+	async exchange(buf) {
+		const request  = new DataView(buf);
+		const sequence = request.getUint32(0, true);
+		const up       = this.upUs + this.jitter();
+		const down     = this.downUs + this.jitter();
+		this.utcUs += BigInt(up);
+		const receive = this.utcUs;
+		this.utcUs += BigInt(this.holdUs);
+		const transmit = this.utcUs;
+		this.utcUs += BigInt(down);
+		this.delays.push(up + down);
+
+		if (this.dropEvery && sequence % this.dropEvery === 0) {
+			timers.pop()();
+			return;
+		}
+		const reply = (seq) => {
+			const value = new DataView(new ArrayBuffer(32));
+			value.setUint32(0, seq, true);
+			value.setBigInt64(4, request.getBigInt64(4, true), true);
+			value.setBigInt64(12, this.knowsTime ? receive : 0n, true);
+			value.setBigInt64(20, this.knowsTime ? transmit : 0n, true);
+			value.setUint32(28, this.knowsTime ? 50 : 0xFFFFFFFF, true);
+			this.config._handleChNotifySync({target: {value: value}});
+		};
+		reply(sequence + 1000);  // Someone else's, which is ignored
+		reply(sequence);
+	}
+
+	async sync(rounds) {
+		this.got = null;
+		await this.config.syncTime(rounds);
+		return this.got;
+	}
+}
+
+async function main() {
+	// With the same delay each way, the offset comes out exactly, and the
+	// bound is half the delay, leaving out the time the clock held it
+	for (const computerOffsetUs of [-3250123, 0, 86400000001]) {
+		const link   = new Link({computerOffsetUs: computerOffsetUs, upUs: 10000, downUs: 10000});
+		const result = await link.sync(1);
+		check(result && result.name === 'Offset', `computer ${computerOffsetUs}us: no offset`);
+		check(Math.abs(result.value.offset - computerOffsetUs) <= 1, `computer ${computerOffsetUs}us: offset ${result.value.offset}`);
+		check(result.value.error === 10000, `error bound ${result.value.error}`);
+	}
+
+	// The offset is out by half the difference between the directions, which
+	// the bound always covers
+	for (const [upUs, downUs] of [[5000, 25000], [30000, 2000], [0, 45000]]) {
+		const link   = new Link({computerOffsetUs: 1234567, upUs: upUs, downUs: downUs});
+		const result = await link.sync(1);
+		const error  = result.value.offset - 1234567;
+		check(Math.abs(error - (downUs - upUs) / 2) <= 1, `${upUs}/${downUs}us: ${error}us off`);
+		check(Math.abs(error) <= result.value.error, `${upUs}/${downUs}us: ${error}us off, bound ${result.value.error}us`);
+	}
+
+	// With queuing, the round trip kept is the fastest, and it beats taking
+	// the first one that comes
+	{
+		const runs = 200;
+		let firstError = 0, keptError = 0;
+		for (let run = 0; run < runs; run++) {
+			const link = new Link({computerOffsetUs: -98765432, upUs: 7500, downUs: 12500, jitterUs: 20000});
+			link.random = random(run + 1);
+			const result = await link.sync(8);
+			const error  = Math.abs(result.value.offset + 98765432);
+			check(result.value.error === Math.min(...link.delays) / 2, `run ${run}: kept delay ${result.value.error * 2}, not the least`);
+			check(error <= result.value.error + 1, `run ${run}: ${error}us off, bound ${result.value.error}us`);
+			keptError += error;
+
+			const first = new Link({computerOffsetUs: -98765432, upUs: 7500, downUs: 12500, jitterUs: 20000});
+			first.random = random(run + 1);
+			firstError += Math.abs((await first.sync(1)).value.offset + 98765432);
+		}
+		firstError /= runs;
+		keptError  /= runs;
+		check(keptError < firstError / 2, `kept ${keptError.toFixed(0)}us off on average, first ${firstError.toFixed(0)}us`);
+		console.log(`time_sync: first round trip ${firstError.toFixed(0)}us off on average, best of 8 ${keptError.toFixed(0)}us`);
+	}
+
+	// Lost replies time out and the rest still count
+	{
+		const link   = new Link({computerOffsetUs: 500000, upUs: 10000, downUs: 10000, dropEvery: 2});
+		const result = await link.sync(8);
+		check(result && Math.abs(result.value.offset - 500000) <= 1, 'lost replies: no offset');
+	}
+
+	// A clock that doesn't know the time gives no offset
+	{
+		const link = new Link({computerOffsetUs: 0, upUs: 10000, downUs: 10000, knowsTime: false});
+		check(await link.sync(8) === null, 'offset from a clock without the time');
+	}
+
+	console.log('time_sync_js_test: ' + (failures ? `FAILED, ${failures} checks failed` : 'passed'));
+	process.exit(failures ? 1 : 0);
+}
+
+main();
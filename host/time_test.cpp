@@ -0,0 +1,131 @@
+// Time_Ticker against time_split(), and the per-second frame cache against
+// building every frame digit by digit, as do_every_ms used to.
+#include "hal.hpp"
+#include "display.hpp"
+#include "time.hpp"
+#include "timing.hpp"
+#include "test.hpp"
+#include <random>
+
+using namespace std::chrono;
+
+static bool same(const Time_Parts& a, const Time_Parts& b)
+{
+	return a.year == b.year && a.month == b.month && a.day == b.day && a.hour == b.hour &&
+	       a.minute == b.minute && a.second == b.second && a.millisecond == b.millisecond;
+}
+
+// A millisecond at a time through every month boundary, leap years included
+static void test_ticker_month_boundaries()
+{
+	for (year_month ym = year{1970} / 1; ym <= year{2099} / 12; ym += months(1))
+	{
+		Time_us boundary = sys_days{ym / 1};
+		Time_Ticker ticker;
+		for (Time_us t = boundary - seconds(2); t < boundary + seconds(2); t += milliseconds(1))
+		{
+			ticker.advance_to(t);
+			CHECK(same(ticker.parts(), time_split(t)), "at %lld us", (long long)t.time_since_epoch().count());
+			CHECK(ticker.ms_start() == t);
+		}
+	}
+}
+
+// Frames come at uneven times: late, early, skipped, and the odd step
+// backwards or forwards, like a GPS correction
+static void test_ticker_jitter()
+{
+	std::mt19937_64 rng(1);
+	Time_Ticker ticker;
+	Time_us t = sys_days{year{1995} / 1 / 1};
+	Time_us end = sys_days{year{2027} / 1 / 1};
+	uint64_t steps = 0;
+	while (t < end)
+	{
+		uint32_t kind = rng() % 1000;
+		if (kind == 0)
+			t -= microseconds(rng() % 5'000'000);
+		else if (kind == 1)
+			t += microseconds(rng() % 86'400'000'000);
+		else
+			t += microseconds(500 + rng() % 1500);
+		// Whole days at a time between checks, to get through the years
+		if (kind == 2)
+			t += days(rng() % 30);
+
+		ticker.advance_to(t);
+		CHECK(same(ticker.parts(), time_split(t)), "at %lld us", (long long)t.time_since_epoch().count());
+		CHECK(ticker.ms_start() == floor<milliseconds>(t));
+		steps++;
+	}
+	CHECK(steps > 500'000, "only %llu steps", (unsigned long long)steps);
+}
+
+// Advancing reports whether anything above the milliseconds changed
+static void test_ticker_changed()
+{
+	Time_Ticker ticker;
+	Time_us t = sys_days{year{2024} / 2 / 29} + hours(23) + minutes(59) + seconds(58);
+	CHECK(ticker.advance_to(t));
+	for (int ms = 1; ms < 3000; ms++)
+	{
+		bool changed = ticker.advance_to(t + milliseconds(ms));
+		CHECK(changed == (ms % 1000 == 0), "at +%d ms", ms);
+	}
+}
+
+// On/off half of the frame last sent to the display
+static std::vector<uint32_t> frame_sent()
+{
+	host_advance_us(2000);  // Let it shift out
+	auto words = host_dma_last_transfer(1);
+	return std::vector<uint32_t>(words.end() - 6, words.end());
+}
+
+static void build_seconds(uint brightness)
+{
+	disp_clear();
+	disp_set_brightness(brightness);
+	disp_set_colons(true);
+	for (uint digit = 1; digit <= 14; digit++)
+		disp_set_num(digit, digit % 10, digit == 14);
+}
+
+// Every millisecond at every resolution, from the table and digit by digit
+static void test_ms_table()
+{
+	disp_init(pio0, 11, 10, 9);
+	for (uint ms_digits = 0; ms_digits <= 3; ms_digits++)
+	{
+		for (uint ms = 0; ms < 1000; ms++)
+		{
+			build_seconds(64);
+			if (ms_digits >= 1)
+				disp_set_num(15, ms / 100 % 10, false);
+			if (ms_digits >= 2)
+				disp_set_num(16, ms /  10 % 10, false);
+			if (ms_digits >= 3)
+				disp_set_num(17, ms       % 10, false);
+			disp_send(false);
+			std::vector<uint32_t> old_frame = frame_sent();
+
+			build_seconds(64);
+			disp_frame_store();
+			disp_clear();  // The cached frame mustn't depend on what's built after it
+			disp_frame_load(ms, ms_digits);
+			disp_send(false);
+			CHECK(frame_sent() == old_frame, "ms %u, %u digits", ms, ms_digits);
+		}
+	}
+}
+
+int main()
+{
+	host_set_time_us(1'000'000);
+	timing_init();
+	test_ticker_month_boundaries();
+	test_ticker_jitter();
+	test_ticker_changed();
+	test_ms_table();
+	return test_result("time_test");
+}
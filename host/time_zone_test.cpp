@@ -0,0 +1,169 @@
+// POSIX TZ rules over 1971-2099.  Every change the host C library finds for
+// the same rule has to be a span boundary here, with the same offsets either
+// side, and there must be no others.  A few changes are also checked by hand,
+// so it isn't only the library agreeing with itself.
+#include "time_zone.hpp"
+#include "test.hpp"
+#include <cstdlib>
+#include <ctime>
+#include <string>
+
+using namespace std::chrono;
+
+static Time_us at(sys_days day, int hour, int minute = 0)
+{
+	return Time_us(day) + hours(hour) + minutes(minute);
+}
+
+// What the C library makes of the rule at t: local minus UTC, and summer time
+struct Libc_Offset
+{
+	long offset_s;
+	bool dst;
+	bool operator==(const Libc_Offset&) const = default;
+};
+
+static Libc_Offset libc_offset(time_t t)
+{
+	tm parts;
+	localtime_r(&t, &parts);
+	return {parts.tm_gmtoff, parts.tm_isdst > 0};
+}
+
+// Zones south of the equator, with summer time in the middle of the year,
+// with the day and time in each form POSIX has, and with times of day that
+// are negative or past 24 hours
+static const char* const rules[] = {
+	"CET-1CEST,M3.5.0,M10.5.0/3",
+	"GMT0BST,M3.5.0/1,M10.5.0",
+	"IST-1GMT0,M10.5.0,M3.5.0/1",            // Summer time is the winter one
+	"EET-2EEST,M3.5.0/3,M10.5.0/4",
+	"EST5EDT,M3.2.0,M11.1.0",
+	"NST3:30NDT,M3.2.0,M11.1.0",
+	"AEST-10AEDT,M10.1.0,M4.1.0/3",
+	"ACST-9:30ACDT,M10.1.0,M4.1.0/3",
+	"NZST-12NZDT,M9.5.0,M4.1.0/3",
+	"<-04>4<-03>,M9.1.6/24,M4.1.6/24",       // Chile: Saturday 24:00
+	"IST-2IDT,M3.4.4/26,M10.5.0",            // Israel: Thursday 26:00, i.e. Friday 02:00
+	"<-03>3<-02>,M3.5.0/-2,M10.5.0/-1",      // Greenland: Saturday 22:00 and 23:00
+	"<+0330>-3:30<+0430>,J79/24,J263/24",    // Iran, as it was: Jn never counts Feb 29
+	"AAA3BBB,59/2,299/2",                    // n counts it, so day 59 is Feb 29 in leap years
+	"AAA3BBB,0/0,364/12",
+	"AAA-5BBB-6:30,M2.5.0/167,M11.1.1/-167", // The extremes of the time of day
+};
+
+// Step through the years a day at a time, then close in on each change the
+// library finds, and compare with the spans
+static void test_against_libc(const char* text)
+{
+	Tz_Rule rule;
+	if (!tz_parse(text, rule))
+	{
+		CHECK(false, "%s didn't parse", text);
+		return;
+	}
+	setenv("TZ", text, 1);
+	tzset();
+
+	auto to_time_t = [](Time_us t) { return time_t(duration_cast<seconds>(t.time_since_epoch()).count()); };
+	const Time_us first = sys_days{year{1971} / 1 / 1};
+	const Time_us last  = sys_days{year{2100} / 1 / 1};
+
+	int changes = 0;
+	Libc_Offset before = libc_offset(to_time_t(first));
+	for (Time_us day = first; day < last; day += days(1))
+	{
+		Libc_Offset after = libc_offset(to_time_t(day + days(1)));
+		if (after == before)
+			continue;
+
+		// The first second with the new offset
+		time_t low = to_time_t(day), high = to_time_t(day + days(1));
+		while (high - low > 1)
+		{
+			time_t mid = low + (high - low) / 2;
+			(libc_offset(mid) == before ? low : high) = mid;
+		}
+		Time_us change{seconds(high)};
+		changes++;
+
+		Tz_Span span = tz_span_at(rule, change);
+		Tz_Span prev = tz_span_at(rule, change - seconds(1));
+		CHECK(span.start == change, "%s: change at %lld, span starts %lld", text,
+			(long long)high, (long long)to_time_t(span.start));
+		CHECK(span.utc_offset_s == after.offset_s && (span.dst_s != 0) == after.dst,
+			"%s at %lld: %d%s, libc %ld%s", text, (long long)high,
+			span.utc_offset_s, span.dst_s ? " dst" : "", after.offset_s, after.dst ? " dst" : "");
+		CHECK(prev.utc_offset_s == before.offset_s && (prev.dst_s != 0) == before.dst,
+			"%s before %lld: %d%s, libc %ld%s", text, (long long)high,
+			prev.utc_offset_s, prev.dst_s ? " dst" : "", before.offset_s, before.dst ? " dst" : "");
+		before = after;
+	}
+
+	// And no changes the library doesn't have
+	int spans = 0;
+	for (Tz_Span span = tz_span_at(rule, first); span.end < last; span = tz_span_at(rule, span.end))
+		spans++;
+	CHECK(spans == changes, "%s: %d spans end before 2100, libc has %d changes", text, spans, changes);
+	CHECK(changes >= 2 * 128, "%s: only %d changes", text, changes);
+}
+
+// Known changes, from the zones' published dates
+static void test_known_changes()
+{
+	struct Known
+	{
+		const char* rule;
+		Time_us     change;     // UTC
+		int32_t     offset_s;   // From then on
+	};
+	const Known known[] = {
+		{"CET-1CEST,M3.5.0,M10.5.0/3",     at(sys_days{year{2021} / 3 / 28}, 1),            2 * 3600},
+		{"CET-1CEST,M3.5.0,M10.5.0/3",     at(sys_days{year{2021} / 10 / 31}, 1),           1 * 3600},
+		{"AEST-10AEDT,M10.1.0,M4.1.0/3",   at(sys_days{year{2024} / 4 / 6}, 16),            10 * 3600},
+		{"AEST-10AEDT,M10.1.0,M4.1.0/3",   at(sys_days{year{2024} / 10 / 5}, 16),           11 * 3600},
+		{"NZST-12NZDT,M9.5.0,M4.1.0/3",    at(sys_days{year{2023} / 9 / 23}, 14),           13 * 3600},
+		{"IST-2IDT,M3.4.4/26,M10.5.0",     at(sys_days{year{2024} / 3 / 29}, 0),            3 * 3600},
+		{"<-04>4<-03>,M9.1.6/24,M4.1.6/24", at(sys_days{year{2024} / 9 / 8}, 4),            -3 * 3600},
+		{"<-03>3<-02>,M3.5.0/-2,M10.5.0/-1", at(sys_days{year{2023} / 3 / 26}, 1),          -2 * 3600},
+		{"NST3:30NDT,M3.2.0,M11.1.0",      at(sys_days{year{2025} / 3 / 9}, 5, 30),         -2 * 3600 - 1800},
+		{"AAA3BBB,59/2,299/2",             at(sys_days{year{2024} / 2 / 29}, 5),            -2 * 3600},
+		{"AAA3BBB,59/2,299/2",             at(sys_days{year{2023} / 3 / 1}, 5),             -2 * 3600},
+		{"<+0330>-3:30<+0430>,J79/24,J263/24", at(sys_days{year{2024} / 3 / 20}, 20, 30),   4 * 3600 + 1800},
+		// No dates, so the US ones.  The C library may take those from tzdata
+		// instead, with their history, so it's only checked here.
+		{"AAA0BBB-1",                      at(sys_days{year{2025} / 3 / 9}, 2),             3600},
+		{"AAA0BBB-1",                      at(sys_days{year{2025} / 11 / 2}, 1),            0},
+	};
+	for (const Known& k : known)
+	{
+		Tz_Rule rule;
+		CHECK(tz_parse(k.rule, rule), "%s didn't parse", k.rule);
+		Tz_Span span = tz_span_at(rule, k.change);
+		CHECK(span.start == k.change && span.utc_offset_s == k.offset_s, "%s: span from %lld at %+ds", k.rule,
+			(long long)duration_cast<seconds>(span.start.time_since_epoch()).count(), span.utc_offset_s);
+	}
+}
+
+static void test_parse()
+{
+	Tz_Rule rule;
+	for (const char* bad : {"", "CET", "CET-1CEST,M3.5.0", "X1Y,M3.5.0,M10.5.0", "AAA3BBB,J0,J365",
+	                        "AAA3BBB,366,0", "AAA3BBB,M13.1.0,M10.5.0", "AAA3BBB,M3.6.0,M10.5.0",
+	                        "AAA3BBB,M3.1.7,M10.5.0", "AAA3BBB,M3.5.0/168,M10.5.0", "AAA25", "<+03-3"})
+		CHECK(!tz_parse(bad, rule), "\"%s\" parsed", bad);
+
+	CHECK(tz_parse("Australia/Sydney", rule) && rule.has_dst && rule.utc_offset_s == 10 * 3600);
+	CHECK(tz_parse("<+0545>-5:45", rule) && !rule.has_dst && rule.utc_offset_s == 5 * 3600 + 45 * 60);
+	CHECK(tz_parse("AAA3BBB2:30:15,M3.2.0/-1:30,M11.1.0", rule) && rule.dst_offset_s == -(2 * 3600 + 30 * 60 + 15));
+	CHECK(rule.dst_start.time_s == -5400);
+}
+
+int main()
+{
+	test_parse();
+	test_known_changes();
+	for (const char* rule : rules)
+		test_against_libc(rule);
+	return test_result("time_zone_test");
+}
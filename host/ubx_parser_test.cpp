@@ -0,0 +1,116 @@
+// Ubx_Ring_Parser with a producer that keeps writing while frames are
+// checked and handled, as the receive DMA does.  A frame it overwrites in
+// that time is dropped; one it only gets close to is copied out first.
+#include "ubx_parser.hpp"
+#include "gps_sim.hpp"
+#include "test.hpp"
+#include <vector>
+
+alignas(2048) static std::array<uint8_t, 2048> ring;
+static uint32_t written;
+
+// What the producer writes the next time the count is read, like bytes
+// arriving during the parse.  0x55 never makes a sync.
+static std::vector<uint32_t> bursts;
+
+static void produce(std::span<const uint8_t> bytes)
+{
+	for (uint8_t b : bytes)
+		ring[written++ % ring.size()] = b;
+}
+
+static uint32_t read_written()
+{
+	if (!bursts.empty())
+	{
+		produce(std::vector<uint8_t>(bursts.front(), 0x55));
+		bursts.erase(bursts.begin());
+	}
+	return written;
+}
+
+static std::vector<uint8_t> payload(uint32_t len, uint8_t seed)
+{
+	std::vector<uint8_t> data(len);
+	for (uint32_t i = 0; i < len; i++)
+		data[i] = uint8_t(seed + i * 7);
+	return data;
+}
+
+static std::vector<std::vector<uint8_t>> handled;
+
+static void keep(std::span<uint8_t> msg)
+{
+	handled.emplace_back(msg.begin(), msg.end());
+	// More bytes arrive while the handler runs
+	produce(std::vector<uint8_t>(800, 0x55));
+	// The handler has to have been given what was checked, not what's there now
+	std::vector<uint8_t> again(msg.begin(), msg.end());
+	CHECK(again == handled.back(), "frame changed under the handler");
+}
+
+static void start()
+{
+	written = 0;
+	bursts.clear();
+	handled.clear();
+}
+
+// The message the parser should hand on for a frame: class, id, length, payload
+static std::vector<uint8_t> msg_of(const std::vector<uint8_t>& frame)
+{
+	return {frame.begin() + 2, frame.end() - 2};
+}
+
+int main()
+{
+	const std::vector<uint8_t> big   = ubx_frame(0x01, 0x21, payload(1000, 1));
+	const std::vector<uint8_t> small = ubx_frame(0x01, 0x26, payload(24, 2));
+
+	// Overwritten between the checksum and handing it on
+	{
+		Ubx_Ring_Parser parser(ring);
+		start();
+		produce(big);
+		bursts = {0, 1100};  // The first read starts the parse
+		parser.parse(read_written, keep);
+		CHECK(handled.empty(), "handled a frame that was overwritten");
+		CHECK(parser.overruns == 1 && parser.frames == 0, "%u overruns, %u frames", parser.overruns, parser.frames);
+
+		// And it carries on with what comes next
+		produce(small);
+		parser.parse(read_written, keep);
+		CHECK(handled.size() == 1 && handled[0] == msg_of(small));
+	}
+
+	// More than half the ring behind, but not lapped: copied out, so writes
+	// during the handler can't touch it
+	{
+		Ubx_Ring_Parser parser(ring);
+		start();
+		produce(big);
+		bursts = {0, 300};
+		parser.parse(read_written, keep);
+		CHECK(handled.size() == 1 && handled[0] == msg_of(big));
+		CHECK(parser.overruns == 0 && parser.frames == 1);
+	}
+
+	// Plenty of room: handed on in place, and a wrapped frame still whole
+	{
+		Ubx_Ring_Parser parser(ring);
+		start();
+		produce(small);
+		parser.parse(read_written, keep);
+		CHECK(handled.size() == 1 && handled[0] == msg_of(small));
+
+		Ubx_Ring_Parser wrapped(ring);
+		start();
+		produce(std::vector<uint8_t>(ring.size() - 10, 0x55));
+		wrapped.parse(read_written, keep);
+		produce(small);
+		wrapped.parse(read_written, keep);
+		CHECK(handled.size() == 1 && handled[0] == msg_of(small));
+	}
+
+	return test_result("ubx_parser_test");
+}
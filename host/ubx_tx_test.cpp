@@ -0,0 +1,93 @@
+// Ubx_Tx_Queue's answers and resends.  An answer can come late, after the
+// frame has timed out and been queued again, or while it's going out
+// again.  Either way it counts, and the frame isn't sent or waited on again.
+#include "ubx_tx.hpp"
+#include "test.hpp"
+#include <vector>
+
+static constexpr uint64_t timeout_us = Ubx_Tx_Queue::ack_timeout_us;
+static const uint8_t payload[] = {0x01, 0x21, 0x01};
+
+// Send up to max_bytes, and return them
+static std::vector<uint8_t> send(Ubx_Tx_Queue& tx, uint64_t now_us, size_t max_bytes = SIZE_MAX)
+{
+	std::vector<uint8_t> sent;
+	for (int byte; sent.size() < max_bytes && (byte = tx.next_byte(now_us)) >= 0;)
+		sent.push_back(byte);
+	return sent;
+}
+
+// Nothing more to send or wait for, however long it's left
+static void check_done(Ubx_Tx_Queue& tx, uint64_t now_us)
+{
+	for (int i = 1; i <= 4; i++)
+	{
+		CHECK(tx.check_timeouts(now_us + i * timeout_us) == 0);
+		CHECK(send(tx, now_us + i * timeout_us).empty(), "sent again");
+	}
+	CHECK(tx.stats.failed == 0);
+}
+
+int main()
+{
+	const size_t frame_len = sizeof(payload) + 8;
+
+	// Answered while queued to go again
+	{
+		Ubx_Tx_Queue tx;
+		tx.push(0x06, 0x01, payload, true);
+		CHECK(send(tx, 0).size() == frame_len);
+		tx.check_timeouts(timeout_us);
+		CHECK(tx.stats.retries == 1);
+		tx.on_answer(0x06, 0x01, true);
+		CHECK(tx.stats.acked == 1 && tx.idle());
+		check_done(tx, timeout_us);
+		CHECK(tx.stats.sent == 1);
+	}
+
+	// Answered halfway through going again: the frame finishes whole
+	{
+		Ubx_Tx_Queue tx;
+		tx.push(0x06, 0x01, payload, true);
+		std::vector<uint8_t> first = send(tx, 0);
+		tx.check_timeouts(timeout_us);
+		std::vector<uint8_t> again = send(tx, timeout_us, 4);
+		tx.on_answer(0x06, 0x01, false);
+		CHECK(tx.stats.naked == 1);
+		std::vector<uint8_t> rest = send(tx, timeout_us);
+		again.insert(again.end(), rest.begin(), rest.end());
+		CHECK(again == first, "resend cut short at %zu bytes", again.size());
+		check_done(tx, timeout_us);
+		CHECK(tx.stats.sent == 2);
+	}
+
+	// Taken out from among others queued, which go as they were
+	{
+		Ubx_Tx_Queue tx;
+		tx.push(0x06, 0x01, payload, true);
+		send(tx, 0);
+		tx.check_timeouts(timeout_us);
+		tx.push(0x06, 0x08, payload, true);
+		tx.push(0x06, 0x24, payload, false);
+		tx.on_answer(0x06, 0x01, true);
+		std::vector<uint8_t> sent = send(tx, timeout_us);
+		CHECK(sent.size() == frame_len * 2 && sent[3] == 0x08 && sent[frame_len + 3] == 0x24);
+		tx.on_answer(0x06, 0x08, true);
+		CHECK(tx.stats.acked == 2);
+		check_done(tx, timeout_us);
+	}
+
+	// Not yet sent at all, so an answer is for something else
+	{
+		Ubx_Tx_Queue tx;
+		tx.push(0x06, 0x01, payload, true);
+		tx.on_answer(0x06, 0x01, true);
+		CHECK(tx.stats.acked == 0);
+		CHECK(send(tx, 0).size() == frame_len);
+		tx.on_answer(0x06, 0x01, true);
+		CHECK(tx.stats.acked == 1);
+		check_done(tx, 0);
+	}
+
+	return test_result("ubx_tx_test");
+}
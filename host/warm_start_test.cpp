@@ -0,0 +1,160 @@
+// Boot to valid time, with and without the state saved last run, against a
+// receiver that kept power through the reset and one that lost it.  Each
+// boot runs in its own process, since gps.cpp keeps its state in statics,
+// and reports back through a pipe.  The receiver that lost power takes 30s
+// to know GPS time and 330s more to hear the leap seconds; with the saved
+// count, that's valid at the first.  One that kept power is where it was
+// left, so with the saved state it's found at the first try.  With none
+// there, the search takes seconds, and the log mustn't lose anything
+// meanwhile.
+#include "hal.hpp"
+#include "boot.hpp"
+#include "gps.hpp"
+#include "gps_sim.hpp"
+#include "log.hpp"
+#include "timing.hpp"
+#include "test.hpp"
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std::chrono;
+
+static const Time_us first_utc = sys_days{year{2025} / 6 / 1} + hours(12);
+
+static constexpr Gps_Message_Rate rates[] = {
+	{0x01, 0x21, 1},  // NAV-TIMEUTC
+	{0x01, 0x26, 1},  // NAV-TIMELS
+};
+
+struct Boot_Result
+{
+	bool       ok;
+	uint32_t   configured_us;  // gps_init_comms() took
+	uint32_t   valid_us;       // Reset to TIME_VALID
+	int64_t    error_us;       // Clock minus the truth when it was valid
+	uint32_t   log_dropped;
+	bool       have_warm;
+	Warm_State warm;           // Saved once locked
+};
+
+// Something logging every 10ms, as the radio and the display do
+static int64_t chatter(alarm_id_t, void*)
+{
+	log_write(Log_Id::GPS_RX_OVERRUN, 0);
+	return 10'000;
+}
+
+static Boot_Result boot(Sim_Receiver receiver, const Warm_State* saved)
+{
+	Boot_Result result = {};
+	timing_init();
+	gps_init_io(uart1, 9600, 5, 4);
+	if (saved)
+		gps_warm_start(*saved);
+	receiver.start();
+	add_alarm_in_us(10'000, chatter, nullptr, true);
+
+	result.ok            = gps_init_comms(115200, rates);
+	result.configured_us = time_us_64();
+	result.log_dropped   = log_dropped();
+	if (!result.ok)
+		return result;
+	while (!gps_get_clock_state().valid && time_us_64() < 600'000'000)
+	{
+		host_advance_us(1000);
+		gps_poll();
+	}
+	result.valid_us = boot_report()[(int)Boot_Phase::TIME_VALID];
+	uint64_t hw_us  = time_us_64();
+	result.error_us = int64_t(hw_us + gps_get_clock_offset_us(hw_us)) - (receiver.utc_at_zero + microseconds(hw_us)).time_since_epoch().count();
+
+	// Run on until it's worth saving
+	while (!(result.have_warm = gps_get_warm_state(result.warm)) && time_us_64() < 900'000'000)
+	{
+		host_advance_us(1000);
+		gps_poll();
+	}
+	return result;
+}
+
+// boot() in a child process
+static Boot_Result boot_apart(const Sim_Receiver& receiver, const Warm_State* saved)
+{
+	int fds[2];
+	Boot_Result result = {};
+	if (pipe(fds) != 0)
+		return result;
+	fflush(stdout);  // Or the child prints it again
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		if (!freopen("/dev/null", "w", stdout))  // The log
+			_exit(1);
+		result = boot(receiver, saved);
+		ssize_t written = write(fds[1], &result, sizeof(result));
+		_exit(written == sizeof(result) ? 0 : 1);
+	}
+	close(fds[1]);
+	if (read(fds[0], &result, sizeof(result)) != sizeof(result))
+		result.ok = false;
+	close(fds[0]);
+	waitpid(pid, nullptr, 0);
+	return result;
+}
+
+static Boot_Result check_boot(const char* what, const Sim_Receiver& receiver, const Warm_State* saved)
+{
+	Boot_Result result = boot_apart(receiver, saved);
+	CHECK(result.ok, "%s: receiver not found", what);
+	CHECK(result.log_dropped == 0, "%s: %u log records dropped", what, result.log_dropped);
+	CHECK(result.valid_us != 0, "%s: never valid", what);
+	CHECK(std::abs(result.error_us) < 1000, "%s: %lldus out when valid", what, (long long)result.error_us);
+	printf("warm_start: %s: configured %.3fs, valid %.3fs\n", what,
+		result.configured_us / 1e6, result.valid_us / 1e6);
+	return result;
+}
+
+int main()
+{
+	// Powered up just now: it has to be found at 9600 and told everything
+	Sim_Receiver lost_power;
+	lost_power.utc_at_zero  = first_utc;
+	lost_power.fix_after_us = 30'000'000;
+	lost_power.utc_after_us = 360'000'000;
+
+	// Running all along at the rate it was left at, and knows the time
+	Sim_Receiver kept_power;
+	kept_power.utc_at_zero = first_utc;
+	kept_power.powered_us  = -3'600'000'000;
+	kept_power.baud        = 115200;
+	kept_power.configured  = true;
+
+	Boot_Result first = check_boot("first boot", lost_power, nullptr);
+	CHECK(first.have_warm, "nothing to save");
+	const Warm_State& warm = first.warm;
+
+	// The rest start an hour on, as if the first had run that long
+	lost_power.utc_at_zero += hours(1);
+	kept_power.utc_at_zero += hours(1);
+
+	Boot_Result lost_cold = check_boot("lost power, nothing saved", lost_power, nullptr);
+	Boot_Result lost_warm = check_boot("lost power, saved state", lost_power, &warm);
+	Boot_Result kept_cold = check_boot("kept power, nothing saved", kept_power, nullptr);
+	Boot_Result kept_warm = check_boot("kept power, saved state", kept_power, &warm);
+
+	// The saved leap seconds give the time as soon as GPS time is known
+	CHECK(lost_cold.valid_us >= lost_power.utc_after_us);
+	CHECK(lost_warm.valid_us < lost_power.fix_after_us + 2'000'000, "valid at %.3fs", lost_warm.valid_us / 1e6);
+	// And the saved baud finds it first time, without a probe timing out
+	CHECK(kept_warm.configured_us < 50'000, "configured in %.3fs", kept_warm.configured_us / 1e6);
+	CHECK(kept_warm.configured_us < kept_cold.configured_us);
+	CHECK(kept_warm.valid_us <= kept_cold.valid_us);
+
+	// Nothing answers at any baud, and the search gives up
+	Sim_Receiver missing;
+	missing.baud = 0;
+	Boot_Result none = boot_apart(missing, nullptr);
+	CHECK(!none.ok && none.configured_us >= 2'000'000, "gave up after %.3fs", none.configured_us / 1e6);
+	CHECK(none.log_dropped == 0, "%u log records dropped while searching", none.log_dropped);
+	return test_result("warm_start_test");
+}
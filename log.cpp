@@ -0,0 +1,103 @@
+#include "log.hpp"
+#include "spsc_queue.hpp"
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include <stdio.h>
+#include <iterator>
+
+// Send records to the debug UART as binary frames, for host/log_decode to
+// turn back into text, instead of formatting them here
+#ifndef LOG_BINARY
+#define LOG_BINARY 0
+#endif
+
+static const char* const formats[] = {
+	"%u log records dropped",
+	"%+dns %+dppb %uus",
+	"GPS rejected %02x %02x",
+	"GPS didn't answer %u messages",
+	"GPS at %u baud, configured",
+	"GPS not responding",
+	"GPS lost after baud change",
+	"GPS at %u baud",
+	"Settings saved, %u frames missed",
+	"Leap second %+d at the end of day %u, smear %u",
+	"GPS receive ring overrun %u times, bytes lost",
+};
+static_assert(std::size(formats) == (int)Log_Id::COUNT);
+
+static Spsc_Queue<Log_Record, 64> queues[2];  // One per core
+static uint32_t reported_drops;
+
+void log_push(const Log_Record& record)
+{
+	// Nothing else on this core can push until it's in.  The other core has
+	// its own queue, so there's nothing to wait for.
+	uint32_t ints = save_and_disable_interrupts();
+	queues[get_core_num()].push(record);
+	restore_interrupts(ints);
+}
+
+uint32_t log_dropped()
+{
+	return queues[0].drops() + queues[1].drops();
+}
+
+uint32_t log_frame(const Log_Record& record, uint8_t (&frame)[log_frame_max])
+{
+	uint32_t size = 0;
+	auto put = [&](uint64_t value, uint32_t bytes) {
+		for (uint32_t i = 0; i < bytes; i++)
+			frame[size++] = value >> (8 * i);
+	};
+	put(log_frame_sync, 1);
+	put((uint16_t)record.id, 2);
+	put(record.num_args, 1);
+	put(record.time_us, 8);
+	for (uint32_t i = 0; i < record.num_args; i++)
+		put(record.args[i], 4);
+
+	uint8_t sum = 0;
+	for (uint32_t i = 1; i < size; i++)
+		sum += frame[i];
+	put(sum, 1);
+	return size;
+}
+
+void log_print(const Log_Record& record)
+{
+	printf("%5u.%06u ", (uint)(record.time_us / 1'000'000), (uint)(record.time_us % 1'000'000));
+	if ((uint32_t)record.id < std::size(formats))
+		printf(formats[(int)record.id], record.args[0], record.args[1], record.args[2], record.args[3]);
+	else
+		printf("unknown log record %u", (uint)record.id);
+	printf("\n");
+}
+
+static void emit(const Log_Record& record)
+{
+#if LOG_BINARY
+	uint8_t frame[log_frame_max];
+	uint32_t size = log_frame(record, frame);
+	for (uint32_t i = 0; i < size; i++)
+		putchar_raw(frame[i]);  // No newline translation
+#else
+	log_print(record);
+#endif
+}
+
+void log_drain()
+{
+	Log_Record record;
+	for (auto& queue : queues)
+		while (queue.pop(record))
+			emit(record);
+
+	// Drops are of records newer than any queued, so they're reported after
+	uint32_t dropped = log_dropped();
+	if (dropped != reported_drops)
+	{
+		emit({.time_us = time_us_64(), .id = Log_Id::DROPPED, .num_args = 1, .args = {dropped - reported_drops}});
+		reported_drops = dropped;
+	}
+}
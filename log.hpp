@@ -0,0 +1,72 @@
+#pragma once
+#include "pico/time.h"
+#include <array>
+#include <cstdint>
+#include <type_traits>
+
+// Deferred logging.  log_write() stores a format ID and up to four integer
+// arguments in a queue, which takes a few dozen cycles from any context, and
+// log_drain() formats them later from the main loop, where blocking on the
+// debug UART delays nothing that matters.  Each core has its own queue, so
+// neither ever waits for the other; when a queue is full, records are
+// dropped and counted.
+
+enum class Log_Id : uint16_t
+{
+	DROPPED,              // Records lost to full queues
+	GPS_FIX,              // Servo error ns, drift ppb, PPS latency us
+	GPS_REJECTED,         // Class and ID of a message the receiver NAKed
+	GPS_NO_ANSWER,        // Messages given up on
+	GPS_CONFIGURED,       // Baud, when the receiver kept its configuration
+	GPS_NOT_RESPONDING,
+	GPS_LOST,             // After a baud change
+	GPS_BAUD,             // Baud, before configuring
+	SETTINGS_SAVED,       // Frames missed while writing
+	GPS_LEAP_SECOND,      // Change in seconds, UTC day it ends (days since 1970), smeared; change 0 when called off
+	GPS_RX_OVERRUN,       // Times the receive ring was lapped before it was parsed
+	COUNT
+};
+
+struct Log_Record
+{
+	static constexpr uint32_t max_args = 4;
+
+	uint64_t time_us;
+	Log_Id   id;
+	uint8_t  num_args;
+	std::array<uint32_t, max_args> args;
+};
+
+void log_push(const Log_Record& record);
+
+// Safe from any core or interrupt.  Arguments are 32-bit at most and are
+// formatted with the printf format for id, so strings can't be logged.
+template <typename... Args>
+void log_write(Log_Id id, Args... args)
+{
+	static_assert(sizeof...(Args) <= Log_Record::max_args, "Too many arguments to log");
+	static_assert(((std::is_integral_v<Args> && sizeof(Args) <= 4) && ...), "Only 32-bit integers can be logged");
+	log_push({
+		.time_us  = time_us_64(),
+		.id       = id,
+		.num_args = sizeof...(Args),
+		.args     = {uint32_t(args)...},
+	});
+}
+
+// Format or send everything queued.  Only call from the main loop's core,
+// outside interrupts: each queue has one reader.
+void log_drain();
+// Records dropped since boot, from both cores
+uint32_t log_dropped();
+
+// Binary framing, for LOG_BINARY builds and host/log_decode: 0xA5, uint16 id,
+// uint8 argument count, uint64 time us, the uint32 arguments, then the low
+// byte of the sum of everything after the 0xA5.  Little endian.  0xA5 can't
+// appear in text, so frames and ordinary printf output can share a stream.
+static constexpr uint8_t  log_frame_sync = 0xA5;
+static constexpr uint32_t log_frame_max  = 1 + 2 + 1 + 8 + 4 * Log_Record::max_args + 1;
+// Returns the frame's length
+uint32_t log_frame(const Log_Record& record, uint8_t (&frame)[log_frame_max]);
+// The text for a record, as log_drain prints it
+void log_print(const Log_Record& record);
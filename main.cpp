@@ -1,158 +1,445 @@
 #include <stdio.h>
 #include "pico/stdlib.h"
+#include "pico/multicore.h"
 #include "hardware/i2c.h"
 #include "hardware/flash.h"
+#include "hardware/sync.h"
 #include "gps.hpp"
 #include "display.hpp"
 #include "ble.hpp"
+#include "boot.hpp"
 #include "config.hpp"
+#include "flash_window.hpp"
+#include "log.hpp"
+#include "pps_capture.hpp"
 #include "time.hpp"
+#include "time_zone.hpp"
+#include "spsc_queue.hpp"
+#include "telemetry.hpp"
+#include "timing.hpp"
+#include <algorithm>
+#include <cstring>
 
 #define GPS_PPS_PIN 3
+#define GPS_BAUD    115200
+
+// How often to save the clock's state for the next boot, once it's locked
+#define WARM_SAVE_PERIOD_US 600'000'000
+
+// Run BTstack and the radio on core 1, so they can't delay display frames
+#define BLE_ON_CORE1 1
+
+// Display refresh rate.  1000 shows milliseconds.  10000 adds a fourth
+// sub-second digit, and drops the hours to make room for it.
+#define DISP_RATE_HZ     1000
+// Shift clock for the LED drivers.  A frame has to get out well inside a period.
+#define DISP_BIT_RATE_HZ (DISP_RATE_HZ > 1000 ? 10'000'000 : 1'000'000)
 
 using namespace std::chrono_literals;
 
+static constexpr Gps_Message_Rate gps_rates[] = {
+	{0xF0, 0x00, 0},  // NMEA GGA off
+	{0xF0, 0x01, 0},  // NMEA GLL off
+	{0xF0, 0x02, 0},  // NMEA GSA off
+	{0xF0, 0x03, 0},  // NMEA GSV off
+	{0xF0, 0x04, 0},  // NMEA RMC off
+	{0xF0, 0x05, 0},  // NMEA VTG off
+	{0x01, 0x03, 1},  // UBX-NAV-STATUS every second, for the fix type
+	{0x01, 0x21, 1},  // UBX-NAV-TIMEUTC every second
+	{0x01, 0x26, 60}, // UBX-NAV-TIMELS every minute, for leap seconds
+	{0x0D, 0x01, 1},  // UBX-TIM-TP every second, for the next edge's quantization error
+};
+
 Config config;
 uint64_t last_ble_tick = 0;
 
+static constexpr int64_t frame_period_us = 1'000'000 / DISP_RATE_HZ;
+static constexpr bool    high_rate       = DISP_RATE_HZ > 1000;
+
+static Time_Ticker time_ticker;
+
+// Key of the per-second frame the display cache holds
+static uint8_t    frame_brightness;
+static bool       frame_show_date;
+
+static bool       frame_splash;
+
+// Hardware time of the millisecond boundary the latched frame is for
+static uint64_t   frame_due_us;
+// Worst latch since the last telemetry record
+static uint32_t   frame_late_max_us;
+
+// Lamp test at boot, shown by the frame alarm while the rest of boot goes on
+static constexpr uint64_t splash_us = 500'000;
+static uint64_t   splash_end_us;
+// Shown in the date's place until there is a date, so it can be found on BLE
+static uint8_t    ble_id;
+static bool       date_shown;
+
+// Traffic between the cores.  Not the hardware FIFOs: multicore lockout
+// for flash writes needs those.
+struct BLE_Message
+{
+	BLECommand command;
+	int32_t    value;
+	std::array<char, sizeof(Config::time_zone_rule)> text;
+};
+static Spsc_Queue<BLE_Time, 4>     ble_ticks;     // Core 0 to core 1
+static Spsc_Queue<BLE_Message, 8>  ble_messages;  // Core 1 to core 0
+
+// Saving waits for gaps between frames, so it's done from the main loop
+static volatile bool save_pending;
+
 static void gpio_isr(uint gpio, uint32_t event_mask)
 {
+	uint32_t start = timing_cycles();
 	if (gpio == GPS_PPS_PIN)
 		gps_on_pps();
+	timing_end(Timing::PPS_ISR, start);
 }
 
-static void ble_command(BLECommand command)
+// Local time follows the rule if there is one, else the whole-hour setting.
+// The frame alarm reads the cache, so it's swapped in with interrupts off.
+static Tz_Cache time_zone;
+
+static void apply_time_zone()
+{
+	Tz_Rule rule = tz_fixed(config.time_zone * 3600);
+	tz_parse(std::string_view(config.time_zone_rule, strnlen(config.time_zone_rule, sizeof(config.time_zone_rule))), rule);
+	uint32_t ints = save_and_disable_interrupts();
+	time_zone.set(rule);
+	restore_interrupts(ints);
+}
+
+static void ble_command(BLECommand command, int32_t value, std::string_view text)
 {
 	switch (command)
 	{
 	case BLECommand::SAVE_SETTINGS:
-		config_write_to_flash(config);
+		save_pending = true;
+		break;
+	case BLECommand::SET_TIME_ZONE:
+		config.time_zone = value;
+		config.time_zone_rule[0] = 0;
+		apply_time_zone();
 		break;
+	case BLECommand::SET_TIME_ZONE_RULE:
+		memset(config.time_zone_rule, 0, sizeof(config.time_zone_rule));
+		text.copy(config.time_zone_rule, sizeof(config.time_zone_rule) - 1);
+		apply_time_zone();
+		break;
+	case BLECommand::SET_BRIGHTNESS:
+		config.brightness = value;
+		break;
+	case BLECommand::SET_LEAP_SMEAR:
+		config.leap_smear = value != 0;
+		gps_set_leap_smear(config.leap_smear);
+		break;
+	}
+}
+
+static void core1_main()
+{
+	// Flash writes from core 0 park this core
+	multicore_lockout_victim_init();
+
+	// The radio's interrupts are set up on whichever core does this
+	ble_init();
+	ble_set_command_cb([](BLECommand command, int32_t value, std::string_view text) {
+		BLE_Message message = {command, value, {}};
+		text.copy(message.text.data(), message.text.size() - 1);
+		ble_messages.push(message);
+	});
+
+	while (true)
+	{
+		BLE_Time tick;
+		while (ble_ticks.pop(tick))
+			ble_tick_time(tick);
+		sleep_ms(1);
 	}
 }
 
+
 int64_t do_every_ms(alarm_id_t id, void *user_data)
 {
-	// Latch the display state we prepped last time
+	uint32_t start_cycles = timing_cycles();
+
+	// Latch the display state we prepped last time, if it's all there
 	disp_latch();
 
 	// Get the time from GPS
-	uint64_t clock_offset_us = gps_get_clock_offset_us();
-	uint32_t time_acc = gps_get_time_accuracy_ns();
-
-	using namespace std::chrono;
 	uint64_t hw_time = to_us_since_boot(get_absolute_time());
-	Time_us time_us = Time_us(microseconds(clock_offset_us)) + microseconds(hw_time);
 
-	if (clock_offset_us > 0)
-		time_us += config.time_zone * 1h;
-	// We're setting up for the next millisecond, so we can just latch it when it's time to display
-	time_us += 1000us;
-	Time_Parts time = time_split(time_us);
+	if (frame_due_us > 0)
+	{
+		uint32_t late_us = hw_time > frame_due_us ? hw_time - frame_due_us : 0;
+		timing_add(Timing::FRAME_LATE, late_us);
+		frame_late_max_us = std::max(frame_late_max_us, late_us);
+	}
 
-	// Update the display for the next millisecond
-	disp_clear();
-	disp_set_brightness(config.brightness);
-	disp_set_colons(true);
+	Clock_State clock = gps_get_clock_state();
+	uint64_t clock_offset_us = clock.offset_us(hw_time);
+	uint32_t time_acc = clock.accuracy_ns;
 
-	if (clock_offset_us > 0)
+	using namespace std::chrono;
+	// We're setting up for the next frame, so we can just latch it when it's time to display
+	Time_us utc_us = Time_us(microseconds(clock_offset_us)) + microseconds(hw_time) + microseconds(frame_period_us);
+	// Only near a leap second does the servo's time need converting
+	bool second_60 = false;
+	if (utc_us >= clock.leap.start)
+		utc_us = clock.leap.to_utc(utc_us, second_60);
+	const Tz_Span& zone = time_zone.at(utc_us);
+	Time_us time_us = clock_offset_us > 0 ? utc_us + seconds(zone.utc_offset_s) : utc_us;
+	// An inserted second goes over 23:59:59 again, so the ticker resyncs
+	// on the way in and ticks on to midnight on the way out
+	bool new_second = time_ticker.advance_to(time_us);
+	const Time_Parts& time = time_ticker.parts();
+	int second = second_60 ? 60 : time.second;
+
+	// Everything but the milliseconds only changes once a second, so build
+	// that frame once and reuse it for the rest of the second.
+	bool splash    = hw_time < splash_end_us;
+	bool show_date = clock_offset_us > 0;
+	if (new_second || config.brightness != frame_brightness || show_date != frame_show_date || splash != frame_splash)
 	{
-		disp_set_num(1, time.year  / 1000 % 10, false);
-		disp_set_num(2, time.year  /  100 % 10, false);
-		disp_set_num(3, time.year  /   10 % 10, false);
-		disp_set_num(4, time.year         % 10, false);
-		disp_set_num(5, time.month /   10 % 10, false);
-		disp_set_num(6, time.month        % 10, false);
-		disp_set_num(7, time.day   /   10 % 10, false);
-		disp_set_num(8, time.day          % 10, false);
-	}
+		frame_brightness = config.brightness;
+		frame_show_date  = show_date;
+		frame_splash     = splash;
+		if (!splash)
+			boot_mark(Boot_Phase::SPLASH_DONE);
 
-	disp_set_num( 9, time.hour   / 10 % 10, false);
-	disp_set_num(10, time.hour        % 10, false);
-	disp_set_num(11, time.minute / 10 % 10, false);
-	disp_set_num(12, time.minute      % 10, false);
-	disp_set_num(13, time.second / 10 % 10, false);
-	disp_set_num(14, time.second      % 10, true);
+		disp_clear();
+		disp_set_brightness(config.brightness);
+		disp_set_colons(true);
 
-	// Degrade display resolution as quality decreases
-	if (clock_offset_us == 0 || time_acc < 100'000'000)  // 100ms
-		disp_set_num(15, time.millisecond / 100 % 10, false);
+		if (show_date)
+		{
+			date_shown = true;
+			disp_set_num(1, time.year  / 1000 % 10, false);
+			disp_set_num(2, time.year  /  100 % 10, false);
+			disp_set_num(3, time.year  /   10 % 10, false);
+			disp_set_num(4, time.year         % 10, false);
+			disp_set_num(5, time.month /   10 % 10, false);
+			disp_set_num(6, time.month        % 10, false);
+			disp_set_num(7, time.day   /   10 % 10, false);
+			disp_set_num(8, time.day          % 10, false);
+		}
+		else if (!date_shown)
+		{
+			disp_set_num(7, ble_id >> 4,   false);
+			disp_set_num(8, ble_id & 0x0f, false);
+		}
+
+		if (high_rate)
+		{	// MM:SS:ssss, with the second colon standing in for the decimal point
+			disp_set_num( 9, time.minute / 10 % 10, false);
+			disp_set_num(10, time.minute      % 10, false);
+			disp_set_num(11, second / 10 % 10, false);
+			disp_set_num(12, second      % 10, false);
+		}
+		else
+		{	// HH:MM:SS sss
+			disp_set_num( 9, time.hour   / 10 % 10, false);
+			disp_set_num(10, time.hour        % 10, false);
+			disp_set_num(11, time.minute / 10 % 10, false);
+			disp_set_num(12, time.minute      % 10, false);
+			disp_set_num(13, second / 10 % 10, false);
+			disp_set_num(14, second      % 10, true);
+		}
+
+		if (splash)
+		{	// Lamp test, everything on
+			for (uint digit = 1; digit < 18; digit++)
+				disp_set_num(digit, 8, true);
+		}
+		disp_frame_store();
+	}
 
-	if (clock_offset_us == 0 || time_acc < 10'000'000)  // 10ms
-		disp_set_num(16, time.millisecond /  10 % 10, false);
-	
-	if (clock_offset_us == 0 || time_acc < 1'000'000)  // 1ms
-		disp_set_num(17, time.millisecond       % 10, false);
+	// Degrade display resolution as quality decreases
+	uint ms_digits = high_rate ? 4 : 3;
+	if (clock_offset_us > 0)
+	{
+		if (time_acc >= 100'000'000)  // 100ms
+			ms_digits = 0;
+		else if (time_acc >= 10'000'000)  // 10ms
+			ms_digits = 1;
+		else if (time_acc >= 1'000'000)  // 1ms
+			ms_digits = 2;
+		else if (time_acc >= 100'000 && high_rate)  // 100us
+			ms_digits = 3;
+	}
+	if (splash)
+		ms_digits = 0;
+	if (high_rate)
+	{	// Sub-second digits start right after the seconds
+		uint sub_second = time.millisecond * 10 + (time_us - time_ticker.ms_start()).count() / 100;
+		disp_frame_load(0, 0);
+		for (uint i = 0, place = 1000; i < ms_digits; i++, place /= 10)
+			disp_set_num(13 + i, sub_second / place % 10, false);
+	}
+	else
+		disp_frame_load(time.millisecond, ms_digits);
 
-	// Send the display data.  Latches brightness, but not state
+	// Send the display data.  Latches brightness, but not state.  If the last
+	// frame is still going out, this one follows it.
 	disp_send(false);
 
 	// Send the time to BLE every second
 	if (hw_time - last_ble_tick > 1'000'000)
 	{
 		last_ble_tick = hw_time;
-		ble_tick_time(time, time_acc);
+		BLE_Time tick = {
+			.utc_us      = clock_offset_us > 0 ? utc_us.time_since_epoch().count() : 0,
+			.accuracy_ns = time_acc,
+			.fix         = gps_get_fix_type(),
+			.servo       = uint8_t(clock.valid ? clock.locked ? 2 : 1 : 0),
+			.utc_offset_s = zone.utc_offset_s,
+			.dst_s        = zone.dst_s,
+		};
+
+		telemetry_add({
+			.time_s         = uint32_t((tick.utc_us ? tick.utc_us : hw_time) / 1'000'000),
+			.error_ns       = clock.error_ns,
+			.drift_ppb      = clock.drift_ppb,
+			.accuracy_ns    = time_acc,
+			.pps_latency_us = uint16_t(std::min<uint32_t>(clock.pps_latency_us, UINT16_MAX)),
+			.frame_late_us  = uint16_t(std::min<uint32_t>(frame_late_max_us, UINT16_MAX)),
+			.state          = uint8_t(tick.fix | tick.servo << 4),
+		});
+		frame_late_max_us = 0;
+
+#if BLE_ON_CORE1
+		ble_ticks.push(tick);
+#else
+		ble_tick_time(tick);
+#endif
 	}
 
 	// Schedule the next update
-	int64_t us_to_next_ms = 1000 - (time_us.time_since_epoch() % 1ms).count();
-	// It takes ~640us to send the display data, so make sure the next one doesn't interrupt
-	if (us_to_next_ms < 800)
-		us_to_next_ms += 1000;
-	return us_to_next_ms;
+	int64_t us_to_next = frame_period_us - (time_us - time_ticker.ms_start()).count() % frame_period_us;
+	frame_due_us = hw_time + us_to_next;
+	// Give the frame most of a period to get out before the next latch
+	if (us_to_next < frame_period_us * 4 / 5)
+		us_to_next += frame_period_us;
+
+	// Flash writes can go now, while the frame has the most time left
+	flash_window_open(frame_due_us, frame_period_us);
+
+	timing_end(Timing::FRAME_TIME, start_cycles);
+	// The SDK counts from when we return, not from when we were called
+	return std::max<int64_t>(hw_time + us_to_next - time_us_64(), 1);
 }
 
 int main()
 {
 	stdio_init_all();
+	timing_init();
 
 	// Do early to keep TX glitch small
 	gps_init_io(uart1, 9600, 5, 4);
 
 	// Get the screen blanked
-	disp_init(pio0, 11, 10, 9);
+	disp_init(pio0, 11, 10, 9, DISP_BIT_RATE_HZ);
 	disp_set_brightness(0);
 	disp_send(true);
+	boot_mark(Boot_Phase::DISPLAY_BLANK);
 
 	// Load config from flash
+	config_init();
 	config_read_from_flash(config);
+	apply_time_zone();
+	gps_set_leap_smear(config.leap_smear);
+	Warm_State warm;
+	if (config_read_warm_state(warm))
+		gps_warm_start(warm);
+	boot_mark(Boot_Phase::CONFIG_LOADED);
 
-	// This can take almost a second!
+	// Cache this before anything can be running from flash while it's read
+	ble_id = ble_get_id();
+
+	// Start the display now.  It shows the lamp test, then the clock, while
+	// the radio and GPS come up behind it.
+	if (disp_frame_time_ns() > frame_period_us * 1000 * 4 / 5)
+		printf("Display frame takes %uns, too long for %uHz\n", (uint)disp_frame_time_ns(), DISP_RATE_HZ);
+	splash_end_us = time_us_64() + splash_us;
+	alarm_pool_init_default();
+	add_alarm_in_us(1000, do_every_ms, nullptr, true);
+	boot_mark(Boot_Phase::CLOCK_STARTED);
+
+#if BLE_ON_CORE1
+	// This can take almost a second, but it's on the other core now
+	multicore_lockout_victim_init();
+	multicore_launch_core1(core1_main);
+#else
+	// This can take almost a second!  Frames carry on meanwhile.
 	ble_init();
 	ble_set_command_cb(ble_command);
+#endif
 
-	// Send init commands to GPS now that it's had plenty of time to start up
-	gps_init_comms();
-
-	// Set up the PPS pin
+	// Set up the PPS pin, so edges are caught while the GPS is configured.
+	// The interrupt only says there was one; PIO has when, to a clock cycle.
+	if (!pps_capture_init(pio1, GPS_PPS_PIN))
+		printf("PPS capture needs a system clock of whole MHz\n");
 	gpio_set_irq_callback(gpio_isr);
 	gpio_set_irq_enabled(GPS_PPS_PIN, GPIO_IRQ_EDGE_RISE, true);
 	irq_set_enabled(IO_IRQ_BANK0, true);
 
-	// Startup screen
-	disp_set_brightness(config.brightness);
-	disp_set_colons(true);
-	for (int i = 1; i < 18; i++)
-		disp_set_num(i, 8, true);
-	disp_send(true);
-	sleep_ms(500);
+	// Waits on the receiver, but only this loop; frames are on the alarm
+	if (gps_init_comms(GPS_BAUD, gps_rates))
+		boot_mark(Boot_Phase::GPS_CONFIGURED);
 
-	disp_clear();
-	disp_set_brightness(config.brightness);
+	uint64_t last_stats_us     = time_us_64();
+	uint64_t last_warm_save_us = 0;
+	bool     warm_saved        = false;
+	bool     boot_reported     = false;
+	while (true)
 	{
-		uint8_t id = ble_get_id();
-		disp_set_num(7, id >> 4,   false);
-		disp_set_num(8, id & 0x0f, false);
-	}
-	disp_send(true);
-	sleep_ms(1000);
+		gps_poll();
+		log_drain();
 
-	// Set up the display refresh timer
-	alarm_pool_init_default();
-	add_alarm_in_us(1000, do_every_ms, nullptr, true);
+		BLE_Message message;
+		while (ble_messages.pop(message))
+			ble_command(message.command, message.value, message.text.data());
 
-	while (true)
-	{
-		sleep_ms(1000);
+		if (save_pending)
+		{
+			save_pending = false;
+			uint32_t missed = flash_window_missed_frames();
+			config_write_to_flash(config);
+			log_write(Log_Id::SETTINGS_SAVED, flash_window_missed_frames() - missed);
+		}
+
+		// As soon as the clock first locks, then every so often
+		if ((!warm_saved || time_us_64() - last_warm_save_us >= WARM_SAVE_PERIOD_US) && gps_get_warm_state(warm))
+		{
+			config_write_warm_state(warm);
+			last_warm_save_us = time_us_64();
+			warm_saved        = true;
+		}
+
+		if (!boot_reported && boot_report()[(int)Boot_Phase::TIME_VALID])
+		{
+			boot_print();
+			boot_reported = true;
+		}
+
+		if (time_us_64() - last_stats_us >= 10'000'000)
+		{
+			last_stats_us = time_us_64();
+			if (!boot_reported)
+				boot_print();
+			timing_publish();
+			timing_print();
+			printf("display overruns %u, frames missed to flash writes %u\n",
+				(uint)disp_overruns(), (uint)flash_window_missed_frames());
+			Gps_Latency latency = gps_get_latency();
+			if (latency.count)
+				printf("PPS to fix latency %u us, min %u, mean %u, max %u over %u fixes\n",
+					(uint)latency.last_us, (uint)latency.min_us, (uint)(latency.total_us / latency.count),
+					(uint)latency.max_us, (uint)latency.count);
+		}
+
+		sleep_ms(1);
 	}
 }
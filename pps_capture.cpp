@@ -0,0 +1,106 @@
+#include "pps_capture.hpp"
+#include "pps_capture.pio.h"
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include <algorithm>
+
+static constexpr uint32_t calibration_samples = 64;
+
+static PIO      pio;
+static int      edge_sm = -1;
+static int      phase_sm;
+static uint     edge_offset;
+static uint32_t cycles_per_us;
+static uint32_t frac_per_cycle;   // 2^-32 us
+static uint32_t max_edge_cycles;  // Older than this, the count isn't for this edge
+// Where pps_phase's count is when the timer ticks.  Every count forced out
+// of it takes the place of one of its own instructions, so each moves this
+// back a cycle.
+static uint32_t tick_phase;
+
+// Cycles into pps_phase's microsecond, from its X: it counts down from
+// cycles_per_us - 2, then goes through zero to all ones
+static uint32_t phase_of(uint32_t x)
+{
+	return cycles_per_us - 2 - x;
+}
+
+// Cycles since the timer last ticked, from pps_phase's count
+static uint32_t take_since_tick()
+{
+	pio_sm_exec(pio, phase_sm, pio_encode_in(pio_x, 32));
+	uint32_t since = (phase_of(pio_sm_get_blocking(pio, phase_sm)) + cycles_per_us - tick_phase) % cycles_per_us;
+	tick_phase = (tick_phase + cycles_per_us - 1) % cycles_per_us;
+	return since;
+}
+
+// Catch the timer ticking over and see where pps_phase is.  Each try is a
+// few cycles late, depending on where the loop was, so the earliest one
+// counts.  The constant part of that delay offsets every edge alike.
+static void calibrate()
+{
+	tick_phase = 0;
+	int32_t n = cycles_per_us;
+	int32_t first = 0, earliest = INT32_MAX;
+	for (uint32_t i = 0; i < calibration_samples; i++)
+	{
+		uint32_t t = time_us_32();
+		while (time_us_32() == t)
+			tight_loop_contents();
+		int32_t since = take_since_tick();
+		if (i == 0)
+			first = since;
+		int32_t from_first = (since - first + n * 3 / 2) % n - n / 2;
+		earliest = std::min(earliest, from_first);
+	}
+	tick_phase = (tick_phase + first + earliest + n) % n;
+}
+
+bool pps_capture_init(PIO pio_, uint pin)
+{
+	uint32_t hz = clock_get_hz(clk_sys);
+	if (hz % 1'000'000 != 0)
+		return false;
+	pio             = pio_;
+	cycles_per_us   = hz / 1'000'000;
+	frac_per_cycle  = uint32_t((uint64_t(1) << 32) / cycles_per_us);
+	max_edge_cycles = hz / 10;
+
+	uint phase_offset = pio_add_program(pio, &pps_phase_program);
+	phase_sm = pio_claim_unused_sm(pio, true);
+	pps_phase_program_init(pio, phase_sm, phase_offset, cycles_per_us);
+	calibrate();
+
+	edge_offset = pio_add_program(pio, &pps_edge_program);
+	int sm = pio_claim_unused_sm(pio, true);
+	pps_edge_program_init(pio, sm, edge_offset, pin);
+	edge_sm = sm;
+	return true;
+}
+
+Pps_Time pps_capture_edge()
+{
+	uint64_t before_us = time_us_64();
+	if (edge_sm < 0)
+		return {before_us, 0};
+
+	// Both counts at once, near enough: a constant few cycles apart
+	pio_sm_exec(pio, edge_sm, pio_encode_in(pio_x, 32));
+	uint32_t since_tick = take_since_tick();
+	uint64_t after_us   = time_us_64();
+	uint32_t edge_x     = pio_sm_get(pio, edge_sm);
+	pio_sm_exec(pio, edge_sm, pio_encode_jmp(edge_offset + pps_edge_offset_start));
+
+	// All ones is still waiting for an edge
+	uint32_t edge_cycles = ~edge_x + pps_edge_sync_cycles;
+	if (edge_x == ~0u || edge_cycles > max_edge_cycles)
+		return {before_us, 0};
+
+	// If the timer ticked between the two reads, the counts came before the
+	// tick only if they're late in the microsecond
+	uint64_t tick_us = since_tick < cycles_per_us / 2 ? after_us : before_us;
+	int64_t  from_tick = int64_t(since_tick) - int64_t(edge_cycles);
+	int64_t  whole_us  = (from_tick - int64_t(cycles_per_us) + 1) / int64_t(cycles_per_us);  // Rounded down
+	uint32_t cycles    = uint32_t(from_tick - whole_us * cycles_per_us);
+	return {tick_us + whole_us, cycles * frac_per_cycle};
+}
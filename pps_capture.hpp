@@ -0,0 +1,19 @@
+#pragma once
+#include "hardware/pio.h"
+#include <cstdint>
+
+// Hardware time of a PPS edge, finer than the timer's microsecond
+struct Pps_Time
+{
+	uint64_t us;
+	uint32_t frac;  // Plus this many 2^-32 us
+};
+
+// Timestamp edges on the PPS pin to a system clock cycle, with two state
+// machines on pio, rather than to whenever the interrupt reads the timer.
+// Needs a system clock of a whole number of MHz, to line the cycles up with
+// the timer's microseconds; returns false without one.
+bool pps_capture_init(PIO pio, uint pin);
+// From the PPS interrupt: when the edge that raised it came.  Until capture
+// is running, or if it missed the edge, it's the timer now.
+Pps_Time pps_capture_edge();
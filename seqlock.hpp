@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Publishes a value from one writer to any number of readers, in interrupts
+// or on the other core, without tearing.  The writer fills whichever of two
+// slots isn't current, then flips to it, so a reader is only ever turned away
+// if the writer published twice while it was copying.
+template <typename T>
+class Seqlock
+{
+public:
+	// Only one writer at a time
+	void write(const T& value)
+	{
+		uint32_t next = current.load(std::memory_order_relaxed) + 1;
+		Slot& slot = slots[next & 1];
+		slot.seq.store(slot.seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);  // Odd: writing
+		std::atomic_thread_fence(std::memory_order_release);
+		slot.value = value;
+		slot.seq.store(slot.seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);  // Even: done
+		current.store(next, std::memory_order_release);
+	}
+
+	T read() const
+	{
+		while (true)
+		{
+			uint32_t index = current.load(std::memory_order_acquire);
+			// If the current slot is being overwritten, the other one was just finished
+			for (uint32_t i : {index, index + 1})
+			{
+				const Slot& slot = slots[i & 1];
+				uint32_t seq = slot.seq.load(std::memory_order_acquire);
+				T value = slot.value;
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (!(seq & 1) && slot.seq.load(std::memory_order_relaxed) == seq)
+					return value;
+			}
+		}
+	}
+
+private:
+	struct Slot
+	{
+		std::atomic<uint32_t> seq{0};
+		T value{};
+	};
+
+	std::atomic<uint32_t> current{0};
+	Slot slots[2];
+};
@@ -0,0 +1,49 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Fixed-size queue from one producer to one consumer, which can be on
+// different cores or in an interrupt.  Neither side ever waits: push fails
+// when the queue is full, and pop when it's empty.  Only plain atomic loads
+// and stores are used, which the M0+ has without locking.
+template <typename T, uint32_t N>
+class Spsc_Queue
+{
+	static_assert(N && (N & (N - 1)) == 0, "Size must be a power of two");
+
+public:
+	// Producer side
+	bool push(const T& item)
+	{
+		uint32_t h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) == N)
+		{
+			dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			return false;
+		}
+		items[h % N] = item;
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side
+	bool pop(T& item)
+	{
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		if (head.load(std::memory_order_acquire) == t)
+			return false;
+		item = items[t % N];
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Items the producer had to throw away
+	uint32_t drops() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+	std::atomic<uint32_t> head{0};  // Next slot to fill; only the producer writes it
+	std::atomic<uint32_t> tail{0};  // Next slot to empty; only the consumer writes it
+	std::atomic<uint32_t> dropped{0};
+	std::array<T, N> items{};
+};
@@ -0,0 +1,67 @@
+#include "telemetry.hpp"
+#include <algorithm>
+#include <cstring>
+
+static Telemetry_History history;
+
+void Telemetry_History::add(const Telemetry_Record& record)
+{
+	uint32_t n = total.load(std::memory_order_relaxed);
+	records[n % num_records] = record;
+	total.store(n + 1, std::memory_order_release);
+}
+
+uint32_t Telemetry_History::oldest() const
+{
+	uint32_t n = next();
+	return n > num_records - 1 ? n - (num_records - 1) : 0;
+}
+
+uint32_t Telemetry_History::pack(uint32_t& cursor, std::span<uint8_t> out) const
+{
+	constexpr uint32_t header = sizeof(uint32_t);
+	if (out.size() < min_batch)
+		return 0;
+
+	while (true)
+	{
+		uint32_t first = std::max(cursor, oldest());
+		uint32_t count = std::min<uint32_t>(next() - first, (out.size() - header) / sizeof(Telemetry_Record));
+		if (count == 0)
+			return 0;
+
+		std::memcpy(out.data(), &first, header);
+		for (uint32_t i = 0; i < count; i++)
+			std::memcpy(out.data() + header + i * sizeof(Telemetry_Record),
+				&records[(first + i) % num_records], sizeof(Telemetry_Record));
+
+		// If the writer came round to the first slot while we copied, it may
+		// be torn.  Try again from the new oldest.
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (first >= oldest())
+		{
+			cursor = first + count;
+			return header + count * sizeof(Telemetry_Record);
+		}
+	}
+}
+
+void telemetry_add(const Telemetry_Record& record)
+{
+	history.add(record);
+}
+
+uint32_t telemetry_next()
+{
+	return history.next();
+}
+
+uint32_t telemetry_oldest()
+{
+	return history.oldest();
+}
+
+uint32_t telemetry_pack(uint32_t& cursor, std::span<uint8_t> out)
+{
+	return history.pack(cursor, out);
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <span>
+
+// Clock health over the last hour, one record a second, for graphing lock
+// quality over BLE.  The display alarm writes records and the BLE stack reads
+// them, possibly on the other core, so the history is lock-free.
+
+// One second, little endian, as the telemetry characteristic sends it
+struct [[gnu::packed]] Telemetry_Record
+{
+	uint32_t time_s;          // UTC seconds since 1970, or since boot if the servo has no time
+	int32_t  error_ns;        // Phase error at the last PPS edge, before it was corrected
+	int32_t  drift_ppb;       // Crystal frequency error.  Positive runs fast.
+	uint32_t accuracy_ns;
+	uint16_t pps_latency_us;  // PPS edge to the message with its time
+	uint16_t frame_late_us;   // Worst display latch after its millisecond this second
+	uint8_t  state;           // Receiver fix in bits 0-3, servo state in 4-5, as in BLE_Time
+};
+
+static_assert(sizeof(Telemetry_Record) == 21);
+
+// Ring of the latest records.  Records are numbered from 0 as they're added;
+// a reader keeps the number of the next one it wants.  The writer never
+// waits, so a reader that falls a whole ring behind skips to the oldest.
+class Telemetry_History
+{
+public:
+	static constexpr uint32_t num_records = 3600;
+	// Smallest batch: the record number and one record
+	static constexpr uint32_t min_batch   = sizeof(uint32_t) + sizeof(Telemetry_Record);
+
+	// Only one writer
+	void add(const Telemetry_Record& record);
+	// Number the next record added will get
+	uint32_t next() const { return total.load(std::memory_order_acquire); }
+	// Oldest record still held.  One slot is kept back for the writer to fill.
+	uint32_t oldest() const;
+	// Fill out with a batch: uint32 number of its first record, then as many
+	// whole records from cursor on as fit.  Moves cursor past them.  Returns
+	// the bytes used, 0 if there's nothing new.
+	uint32_t pack(uint32_t& cursor, std::span<uint8_t> out) const;
+
+private:
+	std::array<Telemetry_Record, num_records> records{};
+	std::atomic<uint32_t> total{0};
+};
+
+// The clock's own history
+void     telemetry_add(const Telemetry_Record& record);
+uint32_t telemetry_next();
+uint32_t telemetry_oldest();
+uint32_t telemetry_pack(uint32_t& cursor, std::span<uint8_t> out);
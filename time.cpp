@@ -18,4 +18,99 @@ Time_Parts time_split(Time_us time_us)
 	time.millisecond = time_hms.subseconds() / 1ms;
 	
 	return time;
-}
\ No newline at end of file
+}
+
+static int days_in_month(int year, int month)
+{
+	static constexpr int days[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+	if (month == 2 && std::chrono::year{year}.is_leap())
+		return 29;
+	return days[month - 1];
+}
+
+void Time_Ticker::resync(Time_us time_us)
+{
+	using namespace std::chrono;
+	start = floor<milliseconds>(time_us);
+	time  = time_split(start);
+}
+
+bool Time_Ticker::tick_ms()
+{
+	start += std::chrono::milliseconds(1);
+	if (++time.millisecond < 1000)
+		return false;
+	time.millisecond = 0;
+	if (++time.second < 60)
+		return true;
+	time.second = 0;
+	if (++time.minute < 60)
+		return true;
+	time.minute = 0;
+	if (++time.hour < 24)
+		return true;
+	time.hour = 0;
+	if (++time.day <= days_in_month(time.year, time.month))
+		return true;
+	time.day = 1;
+	if (++time.month <= 12)
+		return true;
+	time.month = 1;
+	time.year++;
+	return true;
+}
+
+bool Time_Ticker::advance_to(Time_us time_us)
+{
+	using namespace std::chrono;
+
+	// Compare in 64 bits, so we only need 32-bit math from here on
+	if (time_us < start || time_us >= start + 1s)
+	{
+		resync(time_us);
+		return true;
+	}
+
+	bool changed = false;
+	for (int32_t us = (time_us - start).count(); us >= 1000; us -= 1000)
+		changed |= tick_ms();
+	return changed;
+}
+
+Leap_Event Leap_Event::make(Time_us at, int change, bool smear)
+{
+	using namespace std::chrono;
+	if (change == 0)
+		return {};
+	Leap_Event event = {.at = at, .change = change, .smear = smear};
+	if (smear)
+		event.start = at - smear_window / 2;
+	else
+		event.start = change > 0 ? at : at - seconds(1);  // With 23:59:59 deleted, that is midnight
+	return event;
+}
+
+Time_us Leap_Event::end() const
+{
+	using namespace std::chrono;
+	if (smear)
+		return at + smear_window / 2 + seconds(change);
+	return change > 0 ? at + seconds(1) : start;
+}
+
+Time_us Leap_Event::to_utc(Time_us t, bool& second_60) const
+{
+	using namespace std::chrono;
+	second_60 = false;
+	if (t >= end())
+		return t - seconds(change);
+	if (smear)
+	{	// The servo's window is a second longer or shorter than UTC's, and the
+		// difference is paid back evenly across it
+		int64_t window_us = duration_cast<microseconds>(smear_window + seconds(change)).count();
+		return t - microseconds((t - start).count() * change * 1'000'000 / window_us);
+	}
+	// Only an inserted second gets here: servo time [at, at + 1s) is 23:59:60
+	second_60 = true;
+	return t - seconds(1);
+}
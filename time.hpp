@@ -15,4 +15,47 @@ struct Time_Parts
 	int millisecond;
 };
 
-Time_Parts time_split(Time_us time_us);
\ No newline at end of file
+Time_Parts time_split(Time_us time_us);
+
+// Keeps a split time up to date as it moves forward a millisecond at a time,
+// carrying through the calendar instead of doing a full time_split().
+// Jumps backwards or by more than a second fall back to time_split().
+struct Time_Ticker
+{
+	// Bring the parts up to time_us.  Returns true if anything above the
+	// milliseconds changed.
+	bool advance_to(Time_us time_us);
+	const Time_Parts& parts() const { return time; }
+	// Start of the millisecond the parts represent
+	Time_us ms_start() const { return start; }
+
+private:
+	void resync(Time_us time_us);
+	bool tick_ms();
+
+	Time_Parts time  = {};
+	Time_us    start = Time_us::min();
+};
+
+// A leap second at the end of a UTC day.  The clock servo keeps counting
+// straight through it, so PPS edges stay a second apart; past `start` its
+// time has to be converted back to UTC.  Until then the two are the same, so
+// the frame path only has to compare against `start`.  Unarmed, that's never.
+struct Leap_Event
+{
+	Time_us at     = Time_us::max();  // The UTC midnight the leap second ends at
+	Time_us start  = Time_us::max();  // Servo time the conversion starts at
+	int     change = 0;               // +1 inserts 23:59:60, -1 skips 23:59:59
+	bool    smear  = false;           // Spread it over the 24 hours around midnight instead
+
+	static constexpr auto smear_window = std::chrono::hours(24);
+
+	static Leap_Event make(Time_us at, int change, bool smear);
+	bool armed() const { return change != 0; }
+	// Servo time from which UTC is just servo time minus change.  Past this the
+	// servo can be moved onto UTC and the event forgotten.
+	Time_us end() const;
+	// UTC at servo time t, which must be at or past start.  second_60 is set
+	// during an inserted second, when the UTC returned is that of 23:59:59.
+	Time_us to_utc(Time_us t, bool& second_60) const;
+};
@@ -0,0 +1,26 @@
+#include "time_sync.hpp"
+#include <cstring>
+
+bool Time_Sync_Server::on_request(std::span<const uint8_t> data, int64_t receive_us)
+{
+	if (data.size() != sizeof(Time_Sync_Request))
+		return false;
+	memcpy(&request, data.data(), sizeof(request));
+	this->receive_us = receive_us;
+	is_pending = true;
+	return true;
+}
+
+Time_Sync_Response Time_Sync_Server::respond(int64_t transmit_us, uint32_t accuracy_ns)
+{
+	is_pending = false;
+	// Without the time, neither stamp means anything
+	bool known = receive_us != 0 && transmit_us != 0;
+	return {
+		.sequence    = request.sequence,
+		.client_tx   = request.client_tx,
+		.receive_us  = known ? receive_us  : 0,
+		.transmit_us = known ? transmit_us : 0,
+		.accuracy_ns = known ? accuracy_ns : 0xFFFFFFFF,
+	};
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <span>
+
+// NTP-style round trip, so a client can find its offset from the clock and
+// how far to trust it.  The client sends its transmit time t1; the clock
+// stamps the request's arrival t2 and the reply's departure t3 from its
+// disciplined timebase; the client stamps the reply's arrival t4.  Then
+//   offset = ((t2 - t1) + (t3 - t4)) / 2    clock minus client
+//   delay  = (t4 - t1) - (t3 - t2)          time spent in transit
+// and the offset is good to delay / 2, if the two directions take as long.
+// The client is the web page's ClockConfig.syncTime(), which reports the
+// offset the other way round.  Nothing here knows about the transport, so it
+// runs on the host too.
+
+// What the client writes.  Little endian, like everything else on BLE.
+struct [[gnu::packed]] Time_Sync_Request
+{
+	uint32_t sequence;     // Echoed back, to match replies to requests
+	int64_t  client_tx;    // t1, in the client's own clock.  Echoed back.
+};
+
+// What the clock answers with
+struct [[gnu::packed]] Time_Sync_Response
+{
+	uint32_t sequence;
+	int64_t  client_tx;    // t1
+	int64_t  receive_us;   // t2, UTC us since 1970, or 0 if the clock doesn't know the time
+	int64_t  transmit_us;  // t3, likewise
+	uint32_t accuracy_ns;  // Of the clock itself, on top of the round trip's uncertainty
+};
+
+static_assert(sizeof(Time_Sync_Request)  == 12);
+static_assert(sizeof(Time_Sync_Response) == 32);
+
+// The clock's side.  Holds one request at a time; a new one replaces an
+// unanswered one, since its t2 would be stale by the time it went out.
+struct Time_Sync_Server
+{
+	// A request arrived at receive_us.  Returns false if it's malformed.
+	bool on_request(std::span<const uint8_t> data, int64_t receive_us);
+	bool pending() const { return is_pending; }
+	// Stamp the reply as leaving at transmit_us.  Call as close to sending
+	// it as the transport allows.
+	Time_Sync_Response respond(int64_t transmit_us, uint32_t accuracy_ns);
+
+private:
+	Time_Sync_Request request    = {};
+	int64_t           receive_us = 0;
+	bool              is_pending = false;
+};
@@ -0,0 +1,256 @@
+#include "time_zone.hpp"
+#include <algorithm>
+#include <array>
+#include <cctype>
+
+// Common zones, as glibc's tzdata gives their current rules
+static constexpr std::pair<std::string_view, const char*> zones[] = {
+	{"UTC",                 "UTC0"},
+	{"Europe/London",       "GMT0BST,M3.5.0/1,M10.5.0"},
+	{"Europe/Dublin",       "IST-1GMT0,M10.5.0,M3.5.0/1"},
+	{"Europe/Lisbon",       "WET0WEST,M3.5.0/1,M10.5.0"},
+	{"Europe/Paris",        "CET-1CEST,M3.5.0,M10.5.0/3"},
+	{"Europe/Berlin",       "CET-1CEST,M3.5.0,M10.5.0/3"},
+	{"Europe/Helsinki",     "EET-2EEST,M3.5.0/3,M10.5.0/4"},
+	{"Europe/Moscow",       "MSK-3"},
+	{"Asia/Dubai",          "<+04>-4"},
+	{"Asia/Kolkata",        "IST-5:30"},
+	{"Asia/Kathmandu",      "<+0545>-5:45"},
+	{"Asia/Shanghai",       "CST-8"},
+	{"Asia/Tokyo",          "JST-9"},
+	{"Australia/Adelaide",  "ACST-9:30ACDT,M10.1.0,M4.1.0/3"},
+	{"Australia/Brisbane",  "AEST-10"},
+	{"Australia/Sydney",    "AEST-10AEDT,M10.1.0,M4.1.0/3"},
+	{"Pacific/Auckland",    "NZST-12NZDT,M9.5.0,M4.1.0/3"},
+	{"Pacific/Honolulu",    "HST10"},
+	{"America/Anchorage",   "AKST9AKDT,M3.2.0,M11.1.0"},
+	{"America/Los_Angeles", "PST8PDT,M3.2.0,M11.1.0"},
+	{"America/Denver",      "MST7MDT,M3.2.0,M11.1.0"},
+	{"America/Phoenix",     "MST7"},
+	{"America/Chicago",     "CST6CDT,M3.2.0,M11.1.0"},
+	{"America/New_York",    "EST5EDT,M3.2.0,M11.1.0"},
+	{"America/Halifax",     "AST4ADT,M3.2.0,M11.1.0"},
+	{"America/St_Johns",    "NST3:30NDT,M3.2.0,M11.1.0"},
+	{"America/Sao_Paulo",   "<-03>3"},
+};
+
+const char* tz_lookup(std::string_view name)
+{
+	for (const auto& [zone, rule] : zones)
+		if (zone == name)
+			return rule;
+	return nullptr;
+}
+
+Tz_Rule tz_fixed(int32_t utc_offset_s)
+{
+	return {.utc_offset_s = utc_offset_s, .dst_offset_s = utc_offset_s};
+}
+
+// The parsers each take what they understand off the front of text, and
+// return false if it isn't there
+
+static bool parse_name(std::string_view& text)
+{
+	size_t length;
+	if (text.starts_with('<'))
+	{
+		size_t close = text.find('>');
+		if (close == text.npos || close < 4)
+			return false;
+		length = close + 1;
+	}
+	else
+	{
+		length = std::find_if(text.begin(), text.end(), [](char c) { return !isalpha(c); }) - text.begin();
+		if (length < 3)
+			return false;
+	}
+	text.remove_prefix(length);
+	return true;
+}
+
+static bool parse_number(std::string_view& text, int32_t& value, int32_t max)
+{
+	value = 0;
+	size_t digits = 0;
+	while (digits < text.size() && isdigit(text[digits]) && value <= max)
+		value = value * 10 + (text[digits++] - '0');
+	text.remove_prefix(digits);
+	return digits > 0 && value <= max;
+}
+
+// [+-]hh[:mm[:ss]], in seconds
+static bool parse_time(std::string_view& text, int32_t& seconds, int32_t max_hours)
+{
+	int32_t sign = 1;
+	if (text.starts_with('+') || text.starts_with('-'))
+	{
+		sign = text[0] == '-' ? -1 : 1;
+		text.remove_prefix(1);
+	}
+
+	int32_t hours, minutes = 0, secs = 0;
+	if (!parse_number(text, hours, max_hours))
+		return false;
+	if (text.starts_with(':'))
+	{
+		text.remove_prefix(1);
+		if (!parse_number(text, minutes, 59))
+			return false;
+		if (text.starts_with(':'))
+		{
+			text.remove_prefix(1);
+			if (!parse_number(text, secs, 59))
+				return false;
+		}
+	}
+	seconds = sign * (hours * 3600 + minutes * 60 + secs);
+	return true;
+}
+
+// Jn, n or Mm.w.d, then an optional /time
+static bool parse_date(std::string_view& text, Tz_Date& date)
+{
+	int32_t value;
+	date = Tz_Date();
+	if (text.starts_with('J'))
+	{
+		text.remove_prefix(1);
+		if (!parse_number(text, value, 365) || value < 1)
+			return false;
+		date.kind = Tz_Date::JULIAN;
+		date.day  = value;
+	}
+	else if (text.starts_with('M'))
+	{
+		text.remove_prefix(1);
+		int32_t month, week, weekday;
+		if (!parse_number(text, month, 12) || month < 1 || !text.starts_with('.'))
+			return false;
+		text.remove_prefix(1);
+		if (!parse_number(text, week, 5) || week < 1 || !text.starts_with('.'))
+			return false;
+		text.remove_prefix(1);
+		if (!parse_number(text, weekday, 6))
+			return false;
+		date.kind  = Tz_Date::MONTH_WEEK_DAY;
+		date.month = month;
+		date.week  = week;
+		date.day   = weekday;
+	}
+	else
+	{
+		if (!parse_number(text, value, 365))
+			return false;
+		date.kind = Tz_Date::DAY_OF_YEAR;
+		date.day  = value;
+	}
+
+	if (text.starts_with('/'))
+	{
+		text.remove_prefix(1);
+		return parse_time(text, date.time_s, 167);
+	}
+	return true;
+}
+
+bool tz_parse(std::string_view text, Tz_Rule& rule)
+{
+	if (const char* zone_rule = tz_lookup(text))
+		text = zone_rule;
+
+	// POSIX offsets are west of UTC; ours are local minus UTC
+	Tz_Rule parsed;
+	int32_t offset_s;
+	if (!parse_name(text) || !parse_time(text, offset_s, 24))
+		return false;
+	parsed.utc_offset_s = -offset_s;
+	parsed.dst_offset_s = parsed.utc_offset_s;
+
+	if (!text.empty())
+	{
+		if (!parse_name(text))
+			return false;
+		parsed.has_dst      = true;
+		parsed.dst_offset_s = parsed.utc_offset_s + 3600;
+		if (!text.empty() && !text.starts_with(','))
+		{
+			if (!parse_time(text, offset_s, 24))
+				return false;
+			parsed.dst_offset_s = -offset_s;
+		}
+
+		if (text.empty())
+		{	// No dates given.  POSIX leaves it open; glibc uses the US rules.
+			parsed.dst_start = {.month = 3,  .week = 2};
+			parsed.dst_end   = {.month = 11, .week = 1};
+		}
+		else
+		{
+			text.remove_prefix(1);
+			if (!parse_date(text, parsed.dst_start) || !text.starts_with(','))
+				return false;
+			text.remove_prefix(1);
+			if (!parse_date(text, parsed.dst_end))
+				return false;
+		}
+	}
+
+	if (!text.empty())
+		return false;
+	rule = parsed;
+	return true;
+}
+
+// The UTC a change happens in a year, given the offset of the time it ends
+static Time_us transition(const Tz_Date& date, std::chrono::year year, int32_t offset_s)
+{
+	using namespace std::chrono;
+	sys_days day;
+	switch (date.kind)
+	{
+	case Tz_Date::JULIAN:
+		day = sys_days{year / 1 / 1} + days(date.day - 1 + (year.is_leap() && date.day >= 60));
+		break;
+	case Tz_Date::DAY_OF_YEAR:
+		day = sys_days{year / 1 / 1} + days(date.day);
+		break;
+	default:
+		if (date.week == 5)
+			day = sys_days{year / month(date.month) / weekday(date.day)[last]};
+		else
+			day = sys_days{year / month(date.month) / weekday(date.day)[date.week]};
+		break;
+	}
+	return Time_us(day) + seconds(date.time_s - offset_s);
+}
+
+Tz_Span tz_span_at(const Tz_Rule& rule, Time_us utc)
+{
+	if (!rule.has_dst)
+		return {rule.utc_offset_s, 0, Time_us::min(), Time_us::max()};
+
+	// The changes in the years either side too, so there's always one before
+	// and one after.  Sorted, since south of the equator summer spans new year.
+	using namespace std::chrono;
+	struct Change
+	{
+		Time_us at;
+		bool    to_dst;
+	};
+	std::array<Change, 6> changes;
+	year this_year = year_month_day(floor<days>(utc)).year();
+	for (int i = 0; i < 3; i++)
+	{
+		year y = this_year + years(i - 1);
+		changes[i * 2]     = {transition(rule.dst_start, y, rule.utc_offset_s), true};
+		changes[i * 2 + 1] = {transition(rule.dst_end,   y, rule.dst_offset_s), false};
+	}
+	std::sort(changes.begin(), changes.end(), [](const Change& a, const Change& b) { return a.at < b.at; });
+
+	auto next = std::upper_bound(changes.begin(), changes.end(), utc, [](Time_us t, const Change& c) { return t < c.at; });
+	auto last = std::prev(next);
+	int32_t offset_s = last->to_dst ? rule.dst_offset_s : rule.utc_offset_s;
+	return {offset_s, offset_s - rule.utc_offset_s, last->at, next->at};
+}
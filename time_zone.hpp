@@ -0,0 +1,73 @@
+#pragma once
+#include "time.hpp"
+#include <cstdint>
+#include <string_view>
+
+// Time zones as POSIX TZ rules, e.g. "CET-1CEST,M3.5.0,M10.5.0/3": a
+// standard time and its offset, then optionally a summer time, its offset,
+// and when it starts and ends each year.  Offsets are hours west of UTC, as
+// POSIX has them, so "-1" is an hour ahead.  Names can be <quoted> to allow
+// digits and signs, like "<+0545>-5:45".  Olson zone names in a small
+// built-in table are accepted too, and turned into their rule.
+
+// When a change happens each year
+struct Tz_Date
+{
+	enum Kind : uint8_t { JULIAN, DAY_OF_YEAR, MONTH_WEEK_DAY };
+	Kind     kind    = MONTH_WEEK_DAY;
+	uint16_t day     = 0;  // Jn: 1-365, never counting Feb 29.  n: 0-365.  M: weekday, 0 Sunday.
+	uint8_t  month   = 0;  // M only, 1-12
+	uint8_t  week    = 0;  // M only, 1-5, 5 being the last
+	int32_t  time_s  = 2 * 3600;  // Local time of day, in the time being left.  May be negative or over 24h.
+};
+
+struct Tz_Rule
+{
+	int32_t utc_offset_s = 0;      // Standard time, local minus UTC
+	int32_t dst_offset_s = 0;      // Summer time, likewise
+	bool    has_dst      = false;
+	Tz_Date dst_start;
+	Tz_Date dst_end;
+};
+
+// Returns false, leaving rule alone, if text isn't a rule or a known zone
+bool tz_parse(std::string_view text, Tz_Rule& rule);
+// The rule for an Olson name like "Europe/London", or nullptr
+const char* tz_lookup(std::string_view name);
+// A fixed offset, with no summer time
+Tz_Rule tz_fixed(int32_t utc_offset_s);
+
+// A stretch of time with one offset.  Empty until set.
+struct Tz_Span
+{
+	int32_t utc_offset_s = 0;               // Local minus UTC
+	int32_t dst_s        = 0;               // How much of that is summer time
+	Time_us start        = Time_us::max();  // UTC it began, inclusive
+	Time_us end          = Time_us::min();  // UTC it ends, exclusive
+};
+
+// Evaluate the rule for the span holding utc
+Tz_Span tz_span_at(const Tz_Rule& rule, Time_us utc);
+
+// Caches the span in force, so looking up the offset for a time in it is two
+// compares.  The rule is only evaluated again once time leaves the span,
+// twice a year for a zone with summer time and never for one without.
+struct Tz_Cache
+{
+	void set(const Tz_Rule& new_rule)
+	{
+		rule = new_rule;
+		span = Tz_Span();
+	}
+
+	const Tz_Span& at(Time_us utc)
+	{
+		if (utc < span.start || utc >= span.end)
+			span = tz_span_at(rule, utc);
+		return span;
+	}
+
+private:
+	Tz_Rule rule;
+	Tz_Span span;
+};
@@ -0,0 +1,106 @@
+#include "timing.hpp"
+#include "seqlock.hpp"
+#include "hardware/clocks.h"
+#include <stdio.h>
+#include <algorithm>
+
+struct Timing_Info
+{
+	const char* name;
+	bool        cycles;    // Else microseconds
+	uint32_t    width_ns;  // Histogram bucket width
+};
+
+static constexpr std::array<Timing_Info, (int)Timing::COUNT> timing_info = {{
+	{"frame late",  false, 10'000},
+	{"frame time",  true,   2'000},
+	{"disp dma",    true,  50'000},
+	{"pps isr",     true,     500},
+	{"uart tx isr", true,     500},
+	{"ubx handler", true,   5'000},
+}};
+
+static std::array<Timing_Histogram, (int)Timing::COUNT> histograms;
+static uint32_t cycles_per_us;
+static Seqlock<Timing_Report> report;
+
+void Timing_Histogram::add(uint32_t value)
+{
+	buckets[std::min(value / bucket_width, num_buckets - 1)]++;
+	count++;
+	max    = std::max(max, value);
+	total += value;
+}
+
+uint32_t Timing_Histogram::percentile(uint32_t percent) const
+{
+	uint64_t wanted = ((uint64_t)count * percent + 99) / 100;
+	uint64_t seen   = 0;
+	for (uint32_t i = 0; i < num_buckets - 1; i++)
+	{
+		seen += buckets[i];
+		if (seen >= wanted)
+			return std::min((i + 1) * bucket_width, max);
+	}
+	return max;
+}
+
+void timing_init()
+{
+	// Free running at the CPU clock
+	systick_hw->rvr = 0x00FFFFFF;
+	systick_hw->cvr = 0;
+	systick_hw->csr = 0x5;  // Enable, processor clock, no interrupt
+
+	cycles_per_us = clock_get_hz(clk_sys) / 1'000'000;
+	for (uint i = 0; i < histograms.size(); i++)
+	{
+		uint32_t width = timing_info[i].width_ns;
+		width = timing_info[i].cycles ? width * cycles_per_us / 1000 : width / 1000;
+		histograms[i] = {.bucket_width = std::max<uint32_t>(width, 1)};
+	}
+}
+
+void timing_add(Timing which, uint32_t value)
+{
+	histograms[(int)which].add(value);
+}
+
+static uint32_t to_ns(uint i, uint64_t value)
+{
+	value = timing_info[i].cycles ? value * 1000 / cycles_per_us : value * 1000;
+	return std::min<uint64_t>(value, UINT32_MAX);
+}
+
+void timing_publish()
+{
+	Timing_Report summary;
+	for (uint i = 0; i < histograms.size(); i++)
+	{
+		// Taken while the interrupts carry on adding, so only roughly consistent
+		const Timing_Histogram& h = histograms[i];
+		uint32_t count = h.count;
+		summary[i] = {
+			.count   = count,
+			.max_ns  = to_ns(i, h.max),
+			.p50_ns  = to_ns(i, h.percentile(50)),
+			.p99_ns  = to_ns(i, h.percentile(99)),
+			.mean_ns = count ? to_ns(i, h.total / count) : 0,
+		};
+	}
+	report.write(summary);
+}
+
+Timing_Report timing_report()
+{
+	return report.read();
+}
+
+void timing_print()
+{
+	Timing_Report summary = report.read();
+	for (uint i = 0; i < summary.size(); i++)
+		printf("%-12s %8u  max %7uns  p50 %7uns  p99 %7uns  mean %7uns\n", timing_info[i].name,
+			(uint)summary[i].count, (uint)summary[i].max_ns, (uint)summary[i].p50_ns,
+			(uint)summary[i].p99_ns, (uint)summary[i].mean_ns);
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include "hardware/structs/systick.h"
+
+// Timing instrumentation for the display and GPS paths.  Durations are
+// measured in CPU cycles with SysTick, which timing_init() leaves free
+// running.  It's 24 bits, so anything over ~130ms at 125MHz wraps.
+enum class Timing
+{
+	FRAME_LATE,   // Display latch after the millisecond boundary, us
+	FRAME_TIME,   // do_every_ms, cycles
+	DISP_DMA,     // Display DMA start to complete, cycles
+	PPS_ISR,      // PPS edge interrupt, cycles
+	UART_TX_ISR,  // GPS UART TX interrupt, cycles
+	UBX_HANDLER,  // Dispatching one received UBX message, cycles
+	COUNT
+};
+
+// Fixed buckets; the last one also takes everything past the end
+struct Timing_Histogram
+{
+	static constexpr uint32_t num_buckets = 16;
+	uint32_t bucket_width;
+	std::array<uint32_t, num_buckets> buckets;
+	uint32_t count;
+	uint32_t max;
+	uint64_t total;
+
+	void     add(uint32_t value);
+	// Upper edge of the bucket holding the given percentile, or max if that's sooner
+	uint32_t percentile(uint32_t percent) const;
+};
+
+// What the BLE timing characteristic reads: one entry per Timing, all
+// values in nanoseconds, little endian.
+struct [[gnu::packed]] Timing_Summary
+{
+	uint32_t count;
+	uint32_t max_ns;
+	uint32_t p50_ns;
+	uint32_t p99_ns;
+	uint32_t mean_ns;
+};
+using Timing_Report = std::array<Timing_Summary, (int)Timing::COUNT>;
+
+void timing_init();
+
+static inline uint32_t timing_cycles()
+{
+	return systick_hw->cvr;
+}
+
+// Cycles since `start`, as returned by timing_cycles()
+static inline uint32_t timing_elapsed(uint32_t start)
+{
+	return (start - systick_hw->cvr) & 0x00FFFFFF;  // Counts down
+}
+
+// Each Timing must only be added to from one context
+void timing_add(Timing which, uint32_t value);
+// Add the cycles since `start`
+static inline void timing_end(Timing which, uint32_t start)
+{
+	timing_add(which, timing_elapsed(start));
+}
+
+// Summarize everything into the report the BLE characteristic reads
+void timing_publish();
+Timing_Report timing_report();
+void timing_print();
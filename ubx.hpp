@@ -0,0 +1,125 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <span>
+
+// UBX message layouts, one packed struct per class/ID.  Messages are decoded
+// by viewing the payload in the receive buffer as one of these, so nothing
+// is copied.  may_alias makes that legal; packed makes it safe unaligned.
+struct [[gnu::packed, gnu::may_alias]] Ubx_Nav_Status
+{
+	static constexpr uint8_t cls = 0x01, id = 0x03;
+	uint32_t iTOW;     // ms
+	uint8_t  gpsFix;   // 0 none, 2 2D, 3 3D, 5 time only
+	uint8_t  flags;    // Bit 0: fix OK
+	uint8_t  fixStat;
+	uint8_t  flags2;
+	uint32_t ttff;     // ms
+	uint32_t msss;     // ms since startup
+};
+
+struct [[gnu::packed, gnu::may_alias]] Ubx_Nav_TimeUTC
+{
+	static constexpr uint8_t cls = 0x01, id = 0x21;
+	uint32_t iTOW;     // ms
+	uint32_t tAcc;     // ns
+	int32_t  nano;     // ns
+	uint16_t year;
+	uint8_t  month;
+	uint8_t  day;
+	uint8_t  hour;
+	uint8_t  min;
+	uint8_t  sec;
+	uint8_t  valid;    // Bit 0: TOW valid, 1: week valid, 2: UTC valid
+};
+
+struct [[gnu::packed, gnu::may_alias]] Ubx_Nav_TimeLS
+{
+	static constexpr uint8_t cls = 0x01, id = 0x26;
+	uint32_t iTOW;     // ms
+	uint8_t  version;
+	uint8_t  reserved1[3];
+	uint8_t  srcOfCurrLs;
+	int8_t   currLs;   // GPS time minus UTC, s
+	uint8_t  srcOfLsChange;
+	int8_t   lsChange; // At the next event: -1, 0 none, or +1
+	int32_t  timeToLsEvent;  // s, negative if it's passed
+	uint16_t dateOfLsGpsWn;
+	uint16_t dateOfLsGpsDn;
+	uint8_t  reserved2[3];
+	uint8_t  valid;    // Bit 0: currLs valid, 1: timeToLsEvent valid
+};
+
+struct [[gnu::packed, gnu::may_alias]] Ubx_Ack_Nak
+{
+	static constexpr uint8_t cls = 0x05, id = 0x00;
+	uint8_t  clsID;    // Class of the rejected message
+	uint8_t  msgID;
+};
+
+struct [[gnu::packed, gnu::may_alias]] Ubx_Ack_Ack
+{
+	static constexpr uint8_t cls = 0x05, id = 0x01;
+	uint8_t  clsID;    // Class of the accepted message
+	uint8_t  msgID;
+};
+
+struct [[gnu::packed, gnu::may_alias]] Ubx_Tim_TP
+{
+	static constexpr uint8_t cls = 0x0D, id = 0x01;
+	uint32_t towMS;    // Time of the next pulse, ms
+	uint32_t towSubMS; // Sub-ms part, ms * 2^-32
+	int32_t  qErr;     // Quantization error of the next pulse, ps
+	uint16_t week;
+	uint8_t  flags;
+	uint8_t  refInfo;
+};
+
+static_assert(sizeof(Ubx_Nav_Status)  == 16);
+static_assert(sizeof(Ubx_Nav_TimeUTC) == 20);
+static_assert(sizeof(Ubx_Nav_TimeLS)  == 24);
+static_assert(sizeof(Ubx_Ack_Nak)     ==  2);
+static_assert(sizeof(Ubx_Ack_Ack)     ==  2);
+static_assert(sizeof(Ubx_Tim_TP)      == 16);
+
+// One row of a dispatch table: which message, how long it must be, and a
+// decoder that views the payload as that message and calls the handler.
+struct Ubx_Dispatch
+{
+	uint8_t  cls;
+	uint8_t  id;
+	uint16_t length;
+	void   (*decode)(std::span<const uint8_t> payload);
+};
+
+template <typename M, void (*Handler)(const M&)>
+constexpr Ubx_Dispatch ubx_dispatch_entry()
+{
+	return {M::cls, M::id, sizeof(M), [](std::span<const uint8_t> payload) {
+		Handler(*reinterpret_cast<const M*>(payload.data()));
+	}};
+}
+
+// Route a message (class, id, length, payload) to its table entry.  Messages
+// shorter than their layout are dropped; longer ones are allowed, since later
+// protocol versions append fields.  Returns whether a handler ran.
+template <size_t N>
+bool ubx_dispatch(const std::array<Ubx_Dispatch, N>& table, std::span<const uint8_t> msg)
+{
+	if (msg.size() < 4)
+		return false;
+	uint8_t cls = msg[0];
+	uint8_t id  = msg[1];
+	std::span<const uint8_t> payload = msg.subspan(4);
+
+	for (const Ubx_Dispatch& entry : table)
+	{
+		if (entry.cls != cls || entry.id != id)
+			continue;
+		if (payload.size() < entry.length)
+			return false;
+		entry.decode(payload);
+		return true;
+	}
+	return false;
+}
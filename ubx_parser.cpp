@@ -0,0 +1,87 @@
+#include "ubx_parser.hpp"
+
+Ubx_Ring_Parser::Ubx_Ring_Parser(std::span<uint8_t> ring)
+	: ring(ring), mask(ring.size() - 1)
+{
+}
+
+void Ubx_Ring_Parser::parse(Written written_now, Handler handler)
+{
+	uint32_t written = written_now();
+	if (written - tail > ring.size())
+	{	// The oldest bytes have been overwritten.  Carry on from the newest
+		// half of the ring, leaving the other half for the producer to keep
+		// writing into while we parse.
+		overruns++;
+		tail = written - ring.size() / 2;
+	}
+
+	while (true)
+	{
+		uint32_t avail = written - tail;
+
+		// Hunt for the 0xB5, 0x62 sync
+		if (avail < 2)
+			return;
+		if (at(0) != 0xB5 || at(1) != 0x62)
+		{
+			tail++;
+			continue;
+		}
+
+		if (avail < 6)
+			return;  // Wait for the length
+		uint32_t len = at(4) | (at(5) << 8);
+		if (len > max_payload)
+		{	// Can't be real.  Probably synced on payload bytes.
+			bad_frames++;
+			tail++;
+			continue;
+		}
+		if (avail < len + 8)
+			return;  // Wait for the rest
+
+		// Checksum covers class, id, length and payload
+		uint8_t ck_a = 0, ck_b = 0;
+		for (uint32_t i = 2; i < len + 6; i++)
+		{
+			ck_a += at(i);
+			ck_b += ck_a;
+		}
+		if (ck_a != at(len + 6) || ck_b != at(len + 7))
+		{
+			bad_frames++;
+			tail++;
+			continue;
+		}
+
+		// A frame is passed in place only with half the ring still free for
+		// the producer to write into while it's handled.  Otherwise, as when
+		// it wraps around the end, it's copied out first.
+		uint32_t start = (tail + 2) & mask;
+		std::span<uint8_t> msg;
+		if (start + len + 4 <= ring.size() && written_now() - tail <= ring.size() / 2)
+			msg = ring.subspan(start, len + 4);
+		else
+		{
+			for (uint32_t i = 0; i < len + 4; i++)
+				scratch[i] = at(i + 2);
+			msg = std::span(scratch.data(), len + 4);
+		}
+
+		// The checksum only vouches for the frame if the producer hasn't
+		// overwritten any of it since, copy included
+		uint32_t now = written_now();
+		if (now - tail > ring.size())
+		{
+			overruns++;
+			written = now;
+			tail = written - ring.size() / 2;
+			continue;
+		}
+
+		frames++;
+		tail += len + 8;
+		handler(msg);
+	}
+}
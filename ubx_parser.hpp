@@ -0,0 +1,39 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <span>
+
+// Finds UBX frames in a circular receive buffer that something else (DMA)
+// fills, so no work is done per byte as it arrives.  Frames are checksummed
+// before they're handed on.  The few that straddle the end of the ring are
+// copied out to be contiguous; the rest are passed in place.
+struct Ubx_Ring_Parser
+{
+	static constexpr uint32_t max_payload = 1024;
+	// Receives class, id, length and payload, with the sync and checksum stripped
+	using Handler = void (*)(std::span<uint8_t> msg);
+	// Bytes the producer has put in the ring since it started.  The count runs
+	// on past the ring size (and wraps at 2^32), so a producer that laps us can
+	// be told from one that hasn't written anything.
+	using Written = uint32_t (*)();
+
+	// The ring size must be a power of two, and larger than the biggest frame
+	explicit Ubx_Ring_Parser(std::span<uint8_t> ring);
+
+	// Handle every complete frame the producer has written so far.  The count
+	// is read again once each frame is checked, since the producer carries on
+	// meanwhile, and a frame it's overwritten is dropped, not handed on.
+	void parse(Written written, Handler handler);
+
+	uint32_t frames     = 0;
+	uint32_t bad_frames = 0;  // Failed checksum or impossible length
+	uint32_t overruns   = 0;  // Times the producer overwrote bytes not parsed yet
+
+private:
+	uint8_t at(uint32_t i) const { return ring[(tail + i) & mask]; }
+
+	std::span<uint8_t> ring;
+	uint32_t mask;
+	uint32_t tail = 0;       // Bytes consumed, like written
+	std::array<uint8_t, max_payload + 4> scratch;
+};
@@ -0,0 +1,147 @@
+#include "ubx_tx.hpp"
+
+void Ubx_Tx_Queue::enqueue(uint8_t slot)
+{
+	slots[slot].state = Slot_State::queued;
+	queue[queue_tail] = slot;
+	queue_tail = (queue_tail + 1) % queue.size();
+}
+
+// Take a slot out of the send queue, keeping the rest in order
+void Ubx_Tx_Queue::unqueue(uint8_t slot)
+{
+	uint32_t kept = queue_head;
+	for (uint32_t i = queue_head; i != queue_tail; i = (i + 1) % queue.size())
+	{
+		if (queue[i] == slot)
+			continue;
+		queue[kept] = queue[i];
+		kept = (kept + 1) % queue.size();
+	}
+	queue_tail = kept;
+}
+
+bool Ubx_Tx_Queue::push(uint8_t cls, uint8_t id, std::span<const uint8_t> payload, bool want_ack)
+{
+	if (payload.size() > max_payload)
+	{
+		stats.dropped++;
+		return false;
+	}
+
+	uint8_t islot = 0;
+	while (islot < num_slots && slots[islot].state != Slot_State::free)
+		islot++;
+	if (islot == num_slots)
+	{
+		stats.dropped++;
+		return false;
+	}
+
+	Slot& slot    = slots[islot];
+	slot.want_ack = want_ack;
+	slot.tries    = 1;
+	slot.len      = payload.size() + 8;
+	slot.seq      = next_seq++;
+	slot.frame[0] = 0xB5;
+	slot.frame[1] = 0x62;
+	slot.frame[2] = cls;
+	slot.frame[3] = id;
+	slot.frame[4] = payload.size() & 0xFF;
+	slot.frame[5] = payload.size() >> 8;
+	for (uint32_t i = 0; i < payload.size(); i++)
+		slot.frame[6 + i] = payload[i];
+
+	uint8_t ck_a = 0, ck_b = 0;
+	for (uint32_t i = 2; i < slot.len - 2u; i++)
+	{
+		ck_a += slot.frame[i];
+		ck_b += ck_a;
+	}
+	slot.frame[slot.len - 2] = ck_a;
+	slot.frame[slot.len - 1] = ck_b;
+
+	enqueue(islot);
+	return true;
+}
+
+int Ubx_Tx_Queue::next_byte(uint64_t now_us)
+{
+	if (current < 0)
+	{
+		if (queue_head == queue_tail)
+			return -1;
+		current     = queue[queue_head];
+		current_pos = 0;
+		queue_head  = (queue_head + 1) % queue.size();
+	}
+
+	Slot& slot   = slots[current];
+	uint8_t byte = slot.frame[current_pos++];
+	if (current_pos == slot.len)
+	{	// Finished this frame
+		stats.sent++;
+		slot.sent_us = now_us;
+		slot.state   = slot.want_ack ? Slot_State::awaiting_answer : Slot_State::free;
+		current      = -1;
+	}
+	return byte;
+}
+
+void Ubx_Tx_Queue::on_answer(uint8_t cls, uint8_t id, bool ack)
+{
+	// Answers only say which class and id, so it's for the oldest one sent.
+	// That includes one queued to go again, since the answer can be late.
+	int oldest = -1;
+	for (uint8_t islot = 0; islot < num_slots; islot++)
+	{
+		const Slot& slot = slots[islot];
+		bool sent = slot.state == Slot_State::awaiting_answer || (slot.state == Slot_State::queued && slot.tries > 1);
+		if (!sent || !slot.want_ack || slot.frame[2] != cls || slot.frame[3] != id)
+			continue;
+		if (oldest < 0 || int32_t(slot.seq - slots[oldest].seq) < 0)
+			oldest = islot;
+	}
+	if (oldest < 0)
+		return;
+
+	// No point resending something the receiver rejected
+	if (ack)
+		stats.acked++;
+	else
+		stats.naked++;
+	Slot& slot = slots[oldest];
+	if (oldest == current)
+		slot.want_ack = false;  // Halfway out, so let it finish, then it's done
+	else
+	{
+		if (slot.state == Slot_State::queued)
+			unqueue(oldest);
+		slot.state = Slot_State::free;
+	}
+}
+
+uint32_t Ubx_Tx_Queue::check_timeouts(uint64_t now_us)
+{
+	uint32_t failed = 0;
+	for (uint8_t islot = 0; islot < num_slots; islot++)
+	{
+		Slot& slot = slots[islot];
+		if (slot.state != Slot_State::awaiting_answer || now_us - slot.sent_us < ack_timeout_us)
+			continue;
+
+		if (slot.tries < max_tries)
+		{
+			slot.tries++;
+			stats.retries++;
+			enqueue(islot);
+		}
+		else
+		{
+			stats.failed++;
+			failed++;
+			slot.state = Slot_State::free;
+		}
+	}
+	return failed;
+}
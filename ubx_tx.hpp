@@ -0,0 +1,66 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <span>
+
+// Fixed-size queue of outgoing UBX frames, drained a byte at a time by the
+// UART TX interrupt.  Frames that want an answer (CFG) are held after
+// sending until the receiver ACKs or NAKs them, and resent if neither
+// arrives in time.  Not thread safe; callers keep the interrupt out.
+struct Ubx_Tx_Queue
+{
+	static constexpr uint32_t num_slots      = 16;
+	static constexpr uint32_t max_payload    = 40;
+	static constexpr uint32_t ack_timeout_us = 500'000;
+	static constexpr uint8_t  max_tries      = 3;
+
+	struct Stats
+	{
+		uint32_t sent;
+		uint32_t acked;
+		uint32_t naked;
+		uint32_t retries;
+		uint32_t failed;   // No answer after max_tries
+		uint32_t dropped;  // Queue full or payload too long
+	};
+
+	// Frame and queue a message.  Returns false if it can't be queued.
+	bool push(uint8_t cls, uint8_t id, std::span<const uint8_t> payload, bool want_ack);
+	// Next byte to transmit, or -1 if there's nothing to send
+	int  next_byte(uint64_t now_us);
+	// Nothing waiting to go out (though some may still await an answer)
+	bool idle() const { return current < 0 && queue_head == queue_tail; }
+	// The receiver answered a frame of this class and id.  One waiting to be
+	// resent is answered too, and isn't resent.
+	void on_answer(uint8_t cls, uint8_t id, bool ack);
+	// Resend frames whose answer is overdue.  Returns how many were given up on.
+	uint32_t check_timeouts(uint64_t now_us);
+
+	Stats stats = {};
+
+private:
+	enum class Slot_State : uint8_t { free, queued, awaiting_answer };
+
+	struct Slot
+	{
+		Slot_State state;
+		bool       want_ack;
+		uint8_t    tries;
+		uint16_t   len;
+		uint32_t   seq;       // Send order, to match answers to the oldest
+		uint64_t   sent_us;
+		std::array<uint8_t, max_payload + 8> frame;
+	};
+
+	void enqueue(uint8_t slot);
+	void unqueue(uint8_t slot);
+
+	std::array<Slot, num_slots> slots = {};
+	// Ring of slot indexes waiting to be sent; one larger so full != empty
+	std::array<uint8_t, num_slots + 1> queue;
+	uint32_t queue_head = 0;
+	uint32_t queue_tail = 0;
+	int      current    = -1;  // Slot being sent
+	uint32_t current_pos = 0;
+	uint32_t next_seq    = 0;
+};